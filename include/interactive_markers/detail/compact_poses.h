@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INTERACTIVE_MARKERS_COMPACT_POSES_H_
+#define INTERACTIVE_MARKERS_COMPACT_POSES_H_
+
+#include <visualization_msgs/InteractiveMarkerUpdate.h>
+
+#include <stdint.h>
+#include <vector>
+
+namespace interactive_markers
+{
+
+// Pose updates on topic_ns/update_poses_compact are carried in the data
+// field of a std_msgs/UInt8MultiArray. Each message has a table of the
+// distinct headers of its poses, so every frame id is sent once.
+// Positions are multiples of a resolution chosen by the server, stored as
+// variable-length integers. Orientations use the smallest-three encoding
+// with 10 bits per component, which is exact to about 0.1 degrees.
+
+// encode the poses of update, with its server id and sequence number
+// @param resolution   positions are rounded to multiples of this. Must be > 0.
+void encodeCompactPoses( const visualization_msgs::InteractiveMarkerUpdate &update,
+    double resolution, std::vector<uint8_t> &data );
+
+// decode data into an update of type UPDATE that contains only poses
+// @return false if data is not a valid compact pose message
+bool decodeCompactPoses( const std::vector<uint8_t> &data,
+    visualization_msgs::InteractiveMarkerUpdate &update );
+
+}
+
+#endif /* INTERACTIVE_MARKERS_COMPACT_POSES_H_ */
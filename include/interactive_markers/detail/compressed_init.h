@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INTERACTIVE_MARKERS_COMPRESSED_INIT_H_
+#define INTERACTIVE_MARKERS_COMPRESSED_INIT_H_
+
+#include <visualization_msgs/InteractiveMarkerInit.h>
+
+#include <stdint.h>
+#include <vector>
+
+namespace interactive_markers
+{
+
+// Init messages on topic_ns/update_full_compressed are carried in the data
+// field of a std_msgs/UInt8MultiArray: the size of the serialized message
+// as a little-endian uint32, followed by the zlib stream of the serialized message.
+
+// serialize and compress init into data
+// @param level   zlib compression level from 1 (fastest) to 9 (smallest)
+// @return false if zlib failed
+bool compressInit( const visualization_msgs::InteractiveMarkerInit &init,
+    std::vector<uint8_t> &data, int level );
+
+// decompress and deserialize data into init
+// @return false if data is not a valid compressed init message
+bool decompressInit( const std::vector<uint8_t> &data,
+    visualization_msgs::InteractiveMarkerInit &init );
+
+}
+
+#endif /* INTERACTIVE_MARKERS_COMPRESSED_INIT_H_ */
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INTERACTIVE_MARKERS_MESH_DECIMATION_H_
+#define INTERACTIVE_MARKERS_MESH_DECIMATION_H_
+
+#include <visualization_msgs/Marker.h>
+
+#include <stddef.h>
+
+namespace interactive_markers
+{
+
+// Simplify a TRIANGLE_LIST marker by vertex clustering: all vertices within
+// one cell of a grid with the given cell size are merged into their average,
+// and triangles that collapse to a line or a point are dropped.
+// Per-vertex colors are averaged as well, per-triangle colors are kept
+// for the triangles that remain.
+void clusterVertices( visualization_msgs::Marker &marker, double cell_size );
+
+// Cluster the vertices of marker with growing cells until it has at most
+// max_points points.
+// @param[out] decimated  the simplified marker
+// @return false if marker is not a TRIANGLE_LIST or has no more than max_points points
+bool decimateTriangleList( const visualization_msgs::Marker &marker,
+    size_t max_points, visualization_msgs::Marker &decimated );
+
+}
+
+#endif /* INTERACTIVE_MARKERS_MESH_DECIMATION_H_ */
@@ -42,6 +42,8 @@
 #include <visualization_msgs/InteractiveMarkerInit.h>
 #include <visualization_msgs/InteractiveMarkerUpdate.h>
 
+#include "prototypes.h"
+
 namespace interactive_markers
 {
 
@@ -49,32 +51,57 @@ template<class MsgT>
 class MessageContext
 {
 public:
+  // @param prototypes   prototypes of the sending server, which
+  //                     the markers in msg are expanded with
   MessageContext( tf::Transformer& tf,
       const std::string& target_frame,
-      const typename MsgT::ConstPtr& msg);
+      const typename MsgT::ConstPtr& msg,
+      const M_Prototype* prototypes = 0 );
+
+  // copies share the message read-only until one of them changes it
+  MessageContext( const MessageContext<MsgT>& other );
 
   MessageContext<MsgT>& operator=( const MessageContext<MsgT>& other );
 
   // transform all messages with timestamp into target frame
   void getTfTransforms();
 
-  typename MsgT::Ptr msg;
+  // the received message until something in it needs to change,
+  // a private copy afterwards
+  typename MsgT::ConstPtr msg;
 
-  // return true if tf info is complete
+  // return true if tf info and prototypes are complete
   bool isReady();
 
 private:
 
   void init();
 
+  // copy the message the first time it needs to be modified
+  MsgT& mutableMsg();
+
   bool getTransform( std_msgs::Header& header, geometry_msgs::Pose& pose_msg );
 
+  // expand the prototypes of all markers and complete them,
+  // except for those whose prototypes have not arrived yet
+  void completeMarkers();
+
+  // expand and complete the markers whose prototypes have arrived
+  void resolvePrototypes();
+
   void getTfTransforms( std::vector<visualization_msgs::InteractiveMarker>& msg_vec, std::list<size_t>& indices );
-  void getTfTransforms( std::vector<visualization_msgs::InteractiveMarkerPose>& msg_vec, std::list<size_t>& indices );
+  void getPoseTfTransforms( std::list<size_t>& indices );
+
+  // our own copy of msg, if it had to be modified
+  typename MsgT::Ptr mutable_msg_;
 
   // array indices of marker/pose updates with missing tf info
   std::list<size_t> open_marker_idx_;
   std::list<size_t> open_pose_idx_;
+
+  // array indices of markers that wait for their prototypes
+  std::list<size_t> open_prototype_idx_;
+  const M_Prototype* prototypes_;
   tf::Transformer& tf_;
   std::string target_frame_;
 };
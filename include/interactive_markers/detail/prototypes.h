@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INTERACTIVE_MARKERS_PROTOTYPES_H_
+#define INTERACTIVE_MARKERS_PROTOTYPES_H_
+
+#include <visualization_msgs/InteractiveMarker.h>
+#include <visualization_msgs/InteractiveMarkerControl.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace interactive_markers
+{
+
+// A marker refers to a prototype with a control that has no markers and
+// the name prototypeControlName( prototype ). The controls of the prototype
+// take the place of that control when the marker is expanded.
+
+// controls by prototype name
+typedef std::map< std::string, std::vector<visualization_msgs::InteractiveMarkerControl> > M_Prototype;
+
+// name of the control that refers to prototype
+std::string prototypeControlName( const std::string &prototype );
+
+// @return true if int_marker refers to any prototype
+bool usesPrototypes( const visualization_msgs::InteractiveMarker &int_marker );
+
+// @return true if all prototypes that int_marker refers to are in prototypes
+bool prototypesKnown( const visualization_msgs::InteractiveMarker &int_marker,
+    const M_Prototype &prototypes );
+
+// replace the references in int_marker by the controls of their prototypes.
+// References to unknown prototypes are dropped.
+void expandPrototypes( visualization_msgs::InteractiveMarker &int_marker,
+    const M_Prototype &prototypes );
+
+}
+
+#endif /* INTERACTIVE_MARKERS_PROTOTYPES_H_ */
@@ -50,6 +50,7 @@
 #include <tf/tf.h>
 
 #include <deque>
+#include <map>
 
 #include "message_context.h"
 #include "state_machine.h"
@@ -67,7 +68,8 @@ public:
       const std::string& server_id,
       tf::Transformer& tf,
       const std::string& target_frame,
-      const InteractiveMarkerClient::CbCollection& callbacks );
+      const InteractiveMarkerClient::CbCollection& callbacks,
+      const M_Prototype& prototypes );
 
   ~SingleClient();
 
@@ -77,6 +79,9 @@ public:
   // Process message from the init channel
   void process(const visualization_msgs::InteractiveMarkerInit::ConstPtr& msg);
 
+  // Process message from the pose channel
+  void processPoses(const visualization_msgs::InteractiveMarkerUpdate::ConstPtr& msg);
+
   // true if INIT messages are not needed anymore
   bool isInitialized();
 
@@ -102,9 +107,19 @@ private:
   // updateTf implementation (for one queue)
   void transformInitMsgs( );
   void transformUpdateMsgs( );
+  void transformPoseMsgs( );
 
   void pushUpdates();
 
+  // pass on the poses from the pose channel that can be applied already
+  void pushPoses();
+
+  // keep track of the markers sent in full by an update that has just been passed on
+  void updateMarkerSeqNums( const visualization_msgs::InteractiveMarkerUpdate& msg );
+
+  // pass on poses with the given sequence number in an update of their own
+  void pushPoseUpdate( uint64_t seq_num, std::vector<visualization_msgs::InteractiveMarkerPose>& poses );
+
   void errorReset( std::string error_msg );
 
   // sequence number and time of first ever received update
@@ -131,11 +146,38 @@ private:
   // queue for init messages
   M_InitMessageContext init_queue_;
 
+  // queue for messages from the pose channel
+  M_UpdateMessageContext pose_queue_;
+
+  // sequence number of the last init or update passed on
+  uint64_t last_pushed_seq_num_;
+
+  // sequence number of the last init or update that contained each known marker
+  typedef boost::unordered_map<std::string, uint64_t> M_SeqNum;
+  M_SeqNum marker_seq_nums_;
+
+  // a pose passed on ahead of the update with the same sequence number
+  struct EarlyPose
+  {
+    uint64_t seq_num;
+    visualization_msgs::InteractiveMarkerPose pose;
+  };
+  typedef boost::unordered_map<std::string, EarlyPose> M_EarlyPose;
+
+  // poses passed on ahead, to be applied again after older updates of the same marker
+  M_EarlyPose early_poses_;
+
+  // poses of markers that have not been received yet, by sequence number
+  std::map< uint64_t, std::vector<visualization_msgs::InteractiveMarkerPose> > deferred_poses_;
+
   tf::Transformer& tf_;
   std::string target_frame_;
 
   const InteractiveMarkerClient::CbCollection& callbacks_;
 
+  // prototypes received from the server, owned by InteractiveMarkerClient
+  const M_Prototype& prototypes_;
+
   std::string server_id_;
 
   bool warn_keepalive_;
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INTERACTIVE_MARKERS_SPATIAL_GRID_H_
+#define INTERACTIVE_MARKERS_SPATIAL_GRID_H_
+
+#include <geometry_msgs/Point.h>
+
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+
+#include <string>
+#include <vector>
+
+namespace interactive_markers
+{
+
+// Uniform grid over named positions, one per frame.
+// Positions in different frames are never compared.
+class SpatialGrid
+{
+public:
+  SpatialGrid( double cell_size );
+
+  // add an entry or move an existing one
+  void insert( const std::string &name, const std::string &frame_id, const geometry_msgs::Point &position );
+
+  // @return false if there is no entry with that name
+  bool erase( const std::string &name );
+
+  void clear();
+
+  size_t size() const;
+
+  // add the names of all entries in frame_id within the box from min to max
+  void findInBox( const std::string &frame_id,
+      const geometry_msgs::Point &min,
+      const geometry_msgs::Point &max,
+      std::vector<std::string> &names ) const;
+
+  // add the names of all entries in frame_id within radius of center
+  void findInRadius( const std::string &frame_id,
+      const geometry_msgs::Point &center,
+      double radius,
+      std::vector<std::string> &names ) const;
+
+private:
+
+  struct Cell
+  {
+    std::string frame_id;
+    int64_t x, y, z;
+
+    bool operator==( const Cell &other ) const;
+  };
+
+  friend size_t hash_value( const Cell &cell );
+
+  struct Entry
+  {
+    geometry_msgs::Point position;
+    Cell cell;
+  };
+
+  Cell cellFor( const std::string &frame_id, const geometry_msgs::Point &position ) const;
+
+  // add the names of all entries in frame_id within the box from min to max
+  // and, if center is given, within radius of center
+  void find( const std::string &frame_id,
+      const geometry_msgs::Point &min,
+      const geometry_msgs::Point &max,
+      const geometry_msgs::Point *center,
+      double radius,
+      std::vector<std::string> &names ) const;
+
+  double cell_size_;
+
+  boost::unordered_map< std::string, Entry > entries_;
+  boost::unordered_map< Cell, boost::unordered_set<std::string> > cells_;
+};
+
+}
+
+#endif /* INTERACTIVE_MARKERS_SPATIAL_GRID_H_ */
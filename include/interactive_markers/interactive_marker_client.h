@@ -41,11 +41,14 @@
 #include <ros/subscriber.h>
 #include <ros/node_handle.h>
 
+#include <std_msgs/UInt8MultiArray.h>
+
 #include <tf/tf.h>
 
 #include <visualization_msgs/InteractiveMarkerInit.h>
 #include <visualization_msgs/InteractiveMarkerUpdate.h>
 
+#include "detail/prototypes.h"
 #include "detail/state_machine.h"
 
 namespace interactive_markers
@@ -83,7 +86,15 @@ public:
 
   /// @param tf           The tf transformer to use.
   /// @param target_frame tf frame to transform timestamped messages into.
-  /// @param topic_ns     The topic namespace (will subscribe to topic_ns/update, topic_ns/init)
+  /// @param topic_ns     The topic namespace (will subscribe to topic_ns/update,
+  ///                     topic_ns/update_poses, topic_ns/update_poses_compact,
+  ///                     topic_ns/prototypes and topic_ns/init)
+  ///
+  /// The compressed init topic topic_ns/update_full_compressed is preferred.
+  /// The plain one is only subscribed to if, a second after subscribing,
+  /// update() finds more servers publishing updates than compressed states.
+  /// It is dropped again once a compressed init arrives while every server
+  /// publishes one.
   InteractiveMarkerClient( tf::Transformer& tf,
       const std::string& target_frame = "",
       const std::string &topic_ns = "" );
@@ -91,7 +102,8 @@ public:
   /// Will cause a 'reset' call for all server ids
   ~InteractiveMarkerClient();
 
-  /// Subscribe to the topics topic_ns/update and topic_ns/init
+  /// Subscribe to the topics topic_ns/update, topic_ns/update_poses,
+  /// topic_ns/update_poses_compact, topic_ns/prototypes and topic_ns/init
   void subscribe( std::string topic_ns );
 
   /// Unsubscribe, clear queues & call reset callbacks
@@ -135,11 +147,21 @@ private:
   std::string topic_ns_;
 
   ros::Subscriber update_sub_;
+  ros::Subscriber pose_update_sub_;
+  ros::Subscriber compact_pose_update_sub_;
+  ros::Subscriber prototypes_sub_;
   ros::Subscriber init_sub_;
+  ros::Subscriber compressed_init_sub_;
 
-  // subscribe to the init channel
+  // when we started waiting for init messages
+  ros::WallTime init_subscribe_time_;
+
+  // subscribe to the compressed init channel
   void subscribeInit();
 
+  // subscribe to the plain init channel as well
+  void subscribePlainInit();
+
   // subscribe to the init channel
   void subscribeUpdate();
 
@@ -149,6 +171,9 @@ private:
   typedef boost::unordered_map<std::string, SingleClientPtr> M_SingleClient;
   M_SingleClient publisher_contexts_;
 
+  // prototypes by server id. Outlives the single clients, which refer to it.
+  std::map< std::string, M_Prototype > prototypes_;
+
   tf::Transformer& tf_;
   std::string target_frame_;
 
@@ -188,9 +213,21 @@ public:
   // handle init message
   void processInit( const InitConstPtr& msg );
 
+  // handle message from the compressed init topic
+  void processCompressedInit( const std_msgs::UInt8MultiArrayConstPtr& msg );
+
   // handle update message
   void processUpdate( const UpdateConstPtr& msg );
 
+  // handle message from the separate pose topic
+  void processPoseUpdate( const UpdateConstPtr& msg );
+
+  // handle message from the prototype topic
+  void processPrototypes( const InitConstPtr& msg );
+
+  // handle message from the compact pose topic
+  void processCompactPoseUpdate( const std_msgs::UInt8MultiArrayConstPtr& msg );
+
 private:
   CbCollection callbacks_;
 
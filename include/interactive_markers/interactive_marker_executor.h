@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INTERACTIVE_MARKER_EXECUTOR
+#define INTERACTIVE_MARKER_EXECUTOR
+
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <map>
+
+namespace interactive_markers
+{
+
+/// Runs the callbacks of many InteractiveMarkerServer instances on a shared
+/// pool of threads and sends the keep-alive messages of all of them from a
+/// single timer.
+///
+/// Feedback for one server is still handled by one thread at a time,
+/// so feedback callbacks of a server are never called concurrently.
+/// Note: The executor has to outlive all servers that use it.
+class InteractiveMarkerExecutor : boost::noncopyable
+{
+public:
+
+  /// @param num_threads  Number of worker threads. Pass 0 to use one per CPU core.
+  InteractiveMarkerExecutor( unsigned num_threads = 1 );
+
+  /// Stops all worker threads.
+  ~InteractiveMarkerExecutor();
+
+  /// @return the number of worker threads
+  unsigned getNumThreads() const;
+
+private:
+
+  friend class InteractiveMarkerServer;
+
+  // queue processed by the worker threads
+  ros::CallbackQueue* getCallbackQueue();
+
+  // call keep_alive_cb periodically until removeKeepAlive() is called for the same owner
+  void addKeepAlive( const void* owner, const boost::function<void ()> &keep_alive_cb );
+
+  // stop calling the keep-alive callback of owner.
+  // Once this returns, the callback is not running anymore.
+  void removeKeepAlive( const void* owner );
+
+  // main loop of each worker thread
+  void workerThread();
+
+  // call all keep-alive callbacks
+  void keepAlive();
+
+  ros::CallbackQueue callback_queue_;
+  ros::NodeHandle node_handle_;
+  ros::Timer keep_alive_timer_;
+  boost::thread_group worker_threads_;
+  unsigned num_threads_;
+
+  // guards keep_alive_cbs_, held while the callbacks run
+  boost::mutex keep_alive_mutex_;
+  std::map< const void*, boost::function<void ()> > keep_alive_cbs_;
+};
+
+}
+
+#endif
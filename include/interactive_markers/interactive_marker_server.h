@@ -32,20 +32,35 @@
 #ifndef INTERACTIVE_MARKER_SERVER
 #define INTERACTIVE_MARKER_SERVER
 
+#include <visualization_msgs/InteractiveMarkerInit.h>
 #include <visualization_msgs/InteractiveMarkerUpdate.h>
 #include <visualization_msgs/InteractiveMarkerFeedback.h>
+#include <visualization_msgs/MenuEntry.h>
 
+#include <boost/scoped_array.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/future.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
-#include <boost/thread/recursive_mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
 
 #include <ros/ros.h>
 #include <ros/callback_queue.h>
 
+#include <interactive_markers/interactive_marker_executor.h>
+#include <interactive_markers/detail/prototypes.h>
+#include <interactive_markers/detail/spatial_grid.h>
+
 
 #include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/unordered_map.hpp>
 
+#include <deque>
+#include <map>
+#include <set>
+
 namespace interactive_markers
 {
 
@@ -60,8 +75,35 @@ public:
   typedef visualization_msgs::InteractiveMarkerFeedbackConstPtr FeedbackConstPtr;
   typedef boost::function< void ( const FeedbackConstPtr& ) > FeedbackCallback;
 
+  /// Selects the markers sent on a filtered topic, see addFilteredTopic().
+  /// A marker is selected if it matches all criteria that are set.
+  struct InterestFilter
+  {
+    /// Only markers whose name starts with this. Empty to select all.
+    std::string name_prefix;
+
+    /// Only markers in this group, i.e. with this header frame_id. Empty to select all.
+    std::string group_frame;
+
+    /// Only markers with this header frame_id whose position lies within
+    /// the box from region_min to region_max. Empty to select all.
+    std::string region_frame;
+    geometry_msgs::Point region_min;
+    geometry_msgs::Point region_max;
+
+    /// Send triangle lists at the finest level of detail with at most this
+    /// many points, see setLevelsOfDetail(). The coarsest level if none
+    /// is small enough. 0 for full detail.
+    uint32_t max_points;
+
+    InterestFilter() : max_points(0) {}
+  };
+
   static const uint8_t DEFAULT_FEEDBACK_CB = 255;
 
+  /// Seconds between keep-alive messages while nothing else is published
+  static const double KEEP_ALIVE_PERIOD;
+
   /// @param topic_ns      The interface will use the topics topic_ns/update and
   ///                      topic_ns/feedback for communication.
   /// @param server_id     If you run multiple servers on the same topic from
@@ -69,7 +111,20 @@ public:
   ///                      Otherwise, leave this empty.
   /// @param spin_thread   If set to true, will spin up a thread for message handling.
   ///                      All callbacks will be called from that thread.
-  InteractiveMarkerServer( const std::string &topic_ns, const std::string &server_id="", bool spin_thread = false );
+  /// @param num_shards    Number of independently locked parts the markers are
+  ///                      distributed over. Use more than one if many threads
+  ///                      modify different markers at the same time.
+  InteractiveMarkerServer( const std::string &topic_ns, const std::string &server_id="", bool spin_thread = false,
+      unsigned num_shards = 1 );
+
+  /// Create a server whose callbacks run on the worker threads of an executor
+  /// shared with other servers. Keep-alive messages are sent by the executor.
+  /// @param topic_ns      See above
+  /// @param server_id     See above
+  /// @param executor      Runs all callbacks. It has to outlive the server.
+  /// @param num_shards    See above
+  InteractiveMarkerServer( const std::string &topic_ns, const std::string &server_id,
+      InteractiveMarkerExecutor &executor, unsigned num_shards = 1 );
 
   /// Destruction of the interface will lead to all managed markers being cleared.
   ~InteractiveMarkerServer();
@@ -100,6 +155,28 @@ public:
       const geometry_msgs::Pose &pose,
       const std_msgs::Header &header=std_msgs::Header() );
 
+  /// Replace the menu entries of the marker with the specified name.
+  /// Unlike get() followed by insert(), this does not copy the controls of the marker.
+  /// Note: This change will not take effect until you call applyChanges()
+  /// @return true if a marker with that name exists
+  /// @param name          Name of the interactive marker
+  /// @param menu_entries  The new menu entries
+  bool setMenuEntries( const std::string &name,
+      const std::vector<visualization_msgs::MenuEntry> &menu_entries );
+
+  /// Replace the menu entries of several markers and set their callback
+  /// for MENU_SELECT feedback, taking the lock only once.
+  /// Note: This change will not take effect until you call applyChanges()
+  /// @return true if all markers exist
+  /// @param names               Names of the interactive markers
+  /// @param menu_entries        The new menu entries
+  /// @param feedback_cb         Function to call on the arrival of MENU_SELECT feedback
+  /// @param[out] missing_names  Names of the markers that do not exist
+  bool setMenuEntries( const std::vector<std::string> &names,
+      const std::vector<visualization_msgs::MenuEntry> &menu_entries,
+      FeedbackCallback feedback_cb,
+      std::vector<std::string> &missing_names );
+
   /// Erase the marker with the specified name
   /// Note: This change will not take effect until you call applyChanges().
   /// @return true if a marker with that name exists
@@ -127,21 +204,244 @@ public:
   /// broadcast an update to all clients.
   void applyChanges();
 
+  /// Apply changes like applyChanges(), but leave building and publishing
+  /// the messages to a background thread, which is started on the first call.
+  /// The changes are visible through get() as soon as this returns.
+  /// Once the background thread runs, applyChanges() also waits for it,
+  /// so that all updates are published in order.
+  /// @return a future that is ready once the update has been published
+  boost::shared_future<void> applyChangesAsync();
+
   /// Get marker by name
   /// @param name             Name of the interactive marker
   /// @param[out] int_marker  Output message
   /// @return true if a marker with that name exists
   bool get( std::string name, visualization_msgs::InteractiveMarker &int_marker ) const;
 
+  /// Get a read-only handle to the current state of a marker.
+  /// The handle stays valid and unchanged when the marker is modified later on.
+  /// The marker is only copied if it has a pending pose or menu change.
+  /// @param name  Name of the interactive marker
+  /// @return the marker, or an empty pointer if no marker with that name exists
+  visualization_msgs::InteractiveMarkerConstPtr get( const std::string &name ) const;
+
+  /// Get the current pose of a marker without copying anything else
+  /// @param name        Name of the interactive marker
+  /// @param[out] pose   The pose of the marker
+  /// @return true if a marker with that name exists
+  bool getPose( const std::string &name, geometry_msgs::Pose &pose ) const;
+
+  /// Get the current header of a marker without copying anything else
+  /// @param name          Name of the interactive marker
+  /// @param[out] header   The header of the marker
+  /// @return true if a marker with that name exists
+  bool getHeader( const std::string &name, std_msgs::Header &header ) const;
+
+  /// Make insert() and setPose() ignore calls that would not change the marker,
+  /// so that no update is sent for them. insert() compares a hash of the
+  /// complete marker, setPose() compares pose and header. Disabled by default.
+  /// @param skip_unchanged  Enable or disable skipping
+  /// @param pose_epsilon    Also skip pose changes of at most this much in every
+  ///                        component of position and orientation. They are
+  ///                        measured against the last pose that was not skipped.
+  void setSkipUnchanged( bool skip_unchanged, double pose_epsilon = 0.0 );
+
+  /// @return the number of insert() and setPose() calls skipped so far
+  uint64_t getNumSkippedUpdates() const;
+
+  /// Limit how often pose changes of markers are published.
+  /// A pose change that comes too early is held back. The newest pose goes
+  /// out as soon as the interval has passed, with the next applyChanges()
+  /// or on its own if there is none. Other changes are never held back.
+  /// Going out on its own takes a timer on the server's callback queue, so
+  /// without spin_thread or an executor somebody has to spin the global
+  /// queue, as for feedback. Otherwise held poses wait for applyChanges().
+  /// @param name_prefix  Applies to all markers whose name starts with this.
+  ///                     If several prefixes match, the longest one counts.
+  /// @param max_rate     Maximum number of pose updates per second and marker.
+  ///                     Pass 0 to remove the limit for this prefix.
+  void setMaxPublishRate( const std::string &name_prefix, double max_rate );
+
+  /// Set the pose of a marker group. A group is a tf frame broadcast by the server.
+  /// Markers join a group by using the group frame as their header frame_id,
+  /// their pose is then relative to the group. Moving the group moves all
+  /// of its markers with a single transform instead of one pose update each.
+  /// Groups can be nested by using another group frame as the parent frame.
+  /// Note: This change will not take effect until you call applyChanges().
+  /// @param group_frame  Name of the tf frame of the group
+  /// @param pose         Pose of the group frame in the parent frame
+  /// @param header       Parent frame of the group
+  void setGroupPose( const std::string &group_frame,
+      const geometry_msgs::Pose &pose,
+      const std_msgs::Header &header );
+
+  /// Stop broadcasting the frame of a marker group. Its markers are not changed.
+  /// @param group_frame  Name of the tf frame of the group
+  /// @return true if a group with that frame exists
+  bool eraseGroup( const std::string &group_frame );
+
+  /// Get the pose of a marker with all the groups it is in resolved,
+  /// i.e. relative to the first parent frame that is not a group frame.
+  /// Unlike get(), which returns the pose relative to the group.
+  /// @param name          Name of the interactive marker
+  /// @param[out] pose     The resolved pose
+  /// @param[out] header   The header of the marker, with the resolved frame
+  /// @return true if a marker with that name exists
+  bool getAbsolutePose( const std::string &name, geometry_msgs::Pose &pose, std_msgs::Header &header ) const;
+
+  /// Publish pose changes on the topic topic_ns/update_poses instead of
+  /// topic_ns/update, so that they are not held up by large marker
+  /// definitions. Each update is split into two messages with the same
+  /// sequence number, and the poses go out first.
+  /// Note: Only clients that subscribe to the pose topic as well, like
+  ///       InteractiveMarkerClient, will see pose changes.
+  /// @param separate_poses    true to split the updates
+  void setSeparatePoseTopic( bool separate_poses );
+
+  /// Publish pose changes in a compact encoding on the topic
+  /// topic_ns/update_poses_compact, for links with little bandwidth.
+  /// This works like setSeparatePoseTopic(), but frame ids are sent once per
+  /// message, positions are rounded and orientations lose some precision.
+  /// Note: Only clients that subscribe to the compact topic, like
+  ///       InteractiveMarkerClient, will see pose changes.
+  /// @param position_resolution  Positions are rounded to multiples of this.
+  ///                             Pass 0 to publish poses uncompressed again.
+  void setCompactPoses( double position_resolution );
+
+  /// Also publish the complete state zlib-compressed on the latched topic
+  /// topic_ns/update_full_compressed, which InteractiveMarkerClient prefers
+  /// over topic_ns/update_full. Worth it for large meshes on slow links,
+  /// at the cost of compressing the state whenever markers are added or removed.
+  /// Filtered topics are not compressed.
+  /// @param compressed    true to publish the compressed topic
+  void setCompressedInit( bool compressed );
+
+  /// Register controls that many markers share. Markers refer to them with
+  /// usePrototype() and are stored without a copy of them, so memory and,
+  /// with setSharedPrototypes(), message sizes grow with the number of
+  /// prototypes instead of the number of markers.
+  /// Add prototypes before the markers that use them. They cannot be
+  /// changed afterwards, since clients cache them.
+  /// @param prototype  Name of the prototype
+  /// @param controls   Controls of every marker that uses the prototype
+  /// @return false if a prototype with that name exists already
+  bool addPrototype( const std::string &prototype,
+      const std::vector<visualization_msgs::InteractiveMarkerControl> &controls );
+
+  /// Send markers with references to their prototypes instead of the full
+  /// controls, and publish the prototypes on the latched topic topic_ns/prototypes.
+  /// Filtered topics always get the full controls.
+  /// Note: Only clients that subscribe to the prototype topic, like
+  ///       InteractiveMarkerClient, can show markers that use prototypes then.
+  /// @param shared    true to send references
+  void setSharedPrototypes( bool shared );
+
+  /// Limit the size of update messages. The changes applied by one call
+  /// to applyChanges() are split into several updates with consecutive
+  /// sequence numbers if they do not fit into one message.
+  /// A single marker that is larger than the limit still goes out in one message.
+  /// Init messages are never split.
+  /// @param max_size   Maximum serialized size of an update in bytes. Pass 0 for no limit.
+  void setMaxMessageSize( uint32_t max_size );
+
+  /// Keep decimated copies of the large TRIANGLE_LIST markers of every
+  /// marker inserted from now on, which filtered topics can send instead
+  /// of the full geometry, see InterestFilter::max_points.
+  /// The copies are made by vertex clustering when insert() is called.
+  /// @param max_points  Maximum number of points of a triangle list
+  ///                    at each level of detail. Empty for no copies.
+  ///                    Zero entries are ignored.
+  void setLevelsOfDetail( const std::vector<uint32_t> &max_points );
+
+  /// Keep an index of the marker positions, which makes findInBox() and
+  /// findInRadius() independent of the total number of markers.
+  /// The index is updated by insert(), setPose() and erase().
+  /// @param cell_size    Edge length of the grid cells of the index. Should be
+  ///                     around the size of typical queries. Pass 0 to drop the index.
+  void setSpatialIndex( double cell_size );
+
+  /// Get handles to all markers whose header frame_id is frame_id
+  /// and whose position lies within the box from min to max.
+  /// The handles are the same get() returns.
+  /// @return false if there is no spatial index, see setSpatialIndex()
+  bool findInBox( const std::string &frame_id,
+      const geometry_msgs::Point &min,
+      const geometry_msgs::Point &max,
+      std::vector<visualization_msgs::InteractiveMarkerConstPtr> &int_markers ) const;
+
+  /// Get handles to all markers whose header frame_id is frame_id
+  /// and whose position lies within radius of center.
+  /// @return false if there is no spatial index, see setSpatialIndex()
+  bool findInRadius( const std::string &frame_id,
+      const geometry_msgs::Point &center,
+      double radius,
+      std::vector<visualization_msgs::InteractiveMarkerConstPtr> &int_markers ) const;
+
+  /// Additionally publish the markers selected by a filter on the topics
+  /// topic_ns/update and topic_ns/update_full, and accept feedback on
+  /// topic_ns/feedback. Clients that only need these markers can connect
+  /// to topic_ns instead of the main topic namespace.
+  /// The filtered updates are cut out of the same change set as the
+  /// main update. Markers that stop matching are erased on the filtered topic.
+  /// @param topic_ns   Topic namespace of the filtered topics
+  /// @param filter     Selects the markers
+  /// @return false if the topic namespace is already in use
+  bool addFilteredTopic( const std::string &topic_ns, const InterestFilter &filter );
+
+  /// Stop publishing on a filtered topic.
+  /// @param topic_ns   Topic namespace passed to addFilteredTopic()
+  /// @return true if a filtered topic with that namespace exists
+  bool removeFilteredTopic( const std::string &topic_ns );
+
 private:
 
+  typedef boost::shared_ptr<const FeedbackCallback> FeedbackCallbackPtr;
+
+  // Feedback callbacks of one marker, indexed by feedback event type.
+  // Tables are never modified once they are shared, so markers with the
+  // same callbacks can point to the same table.
+  class FeedbackCallbackTable
+  {
+  public:
+    // true if there is a slot for the given event type or DEFAULT_FEEDBACK_CB
+    static bool hasSlot( uint8_t feedback_type );
+
+    // set or unset the callback for one event type or DEFAULT_FEEDBACK_CB
+    void set( uint8_t feedback_type, const FeedbackCallbackPtr &feedback_cb );
+
+    // type-specific callback if there is one, otherwise the default callback
+    const FeedbackCallbackPtr& get( uint8_t feedback_type ) const;
+
+  private:
+    // one slot per event type, plus one for the default callback
+    static const unsigned NUM_SLOTS = visualization_msgs::InteractiveMarkerFeedback::MOUSE_UP + 2;
+    FeedbackCallbackPtr slots_[NUM_SLOTS];
+  };
+
+  typedef boost::shared_ptr<const FeedbackCallbackTable> FeedbackCallbackTablePtr;
+
+  // the decimated controls of one level of detail by their index in the
+  // marker. The other controls are the same as in the full marker.
+  typedef std::map< size_t, visualization_msgs::InteractiveMarkerControl > M_DecimatedControl;
+
+  // decimated controls of one marker by the maximum number of
+  // points per triangle list, see setLevelsOfDetail()
+  typedef std::map< uint32_t, M_DecimatedControl > M_LevelOfDetail;
+  typedef boost::shared_ptr<const M_LevelOfDetail> LevelsOfDetailConstPtr;
+
   struct MarkerContext
   {
     ros::Time last_feedback;
     std::string last_client_id;
-    FeedbackCallback default_feedback_cb;
-    boost::unordered_map<uint8_t,FeedbackCallback> feedback_cbs;
-    visualization_msgs::InteractiveMarker int_marker;
+    FeedbackCallbackTablePtr feedback_cbs;
+    // shared with the handles returned by get(), use mutableMarker() to modify it
+    visualization_msgs::InteractiveMarkerPtr int_marker;
+    // hash of int_marker when it was inserted, 0 if unknown or modified since
+    size_t fingerprint;
+    // when a change of this marker was applied last, see setMaxPublishRate()
+    ros::WallTime last_publish_time;
+    // decimated controls of int_marker, NULL if there are none
+    LevelsOfDetailConstPtr levels_of_detail;
   };
 
   typedef boost::unordered_map< std::string, MarkerContext > M_MarkerContext;
@@ -152,63 +452,413 @@ private:
     enum {
       FULL_UPDATE,
       POSE_UPDATE,
+      MENU_UPDATE,
       ERASE
     } update_type;
-    visualization_msgs::InteractiveMarker int_marker;
-    FeedbackCallback default_feedback_cb;
-    boost::unordered_map<uint8_t,FeedbackCallback> feedback_cbs;
+    // the new marker (FULL_UPDATE), use mutableMarker() to modify it
+    visualization_msgs::InteractiveMarkerPtr int_marker;
+    // hash of the new marker (FULL_UPDATE), 0 if unknown or modified since
+    size_t fingerprint;
+    // decimated controls of the new marker (FULL_UPDATE)
+    LevelsOfDetailConstPtr levels_of_detail;
+    // the new pose & header (POSE_UPDATE, MENU_UPDATE)
+    geometry_msgs::Pose pose;
+    std_msgs::Header header;
+    // the new menu (MENU_UPDATE)
+    std::vector<visualization_msgs::MenuEntry> menu_entries;
+    FeedbackCallbackTablePtr feedback_cbs;
+    // applied, but held back by the maximum publish rate (POSE_UPDATE).
+    // Cleared by any later change, which then waits for applyChanges().
+    bool held;
   };
 
   typedef boost::unordered_map< std::string, UpdateContext > M_UpdateContext;
 
+  // One independently locked part of the marker state.
+  // Each marker lives in the shard selected by the hash of its name.
+  struct MarkerShard
+  {
+    MarkerShard();
+
+    // guards the state of this shard. Readers like get() share the lock,
+    // everything that modifies the state holds it exclusively.
+    // User callbacks are never called with the lock held.
+    mutable boost::shared_mutex mutex;
+
+    // contains the current state of all markers in this shard
+    M_MarkerContext marker_contexts;
+
+    // updates that have to be sent on the next publish
+    M_UpdateContext pending_updates;
+
+    // last replacement done by replaceCallback()
+    FeedbackCallbackTablePtr last_replaced_cbs;
+    FeedbackCallbackTablePtr last_replacement_cbs;
+    FeedbackCallbackPtr last_replacement_cb;
+    uint8_t last_replacement_type;
+
+    // see setSkipUnchanged()
+    bool skip_unchanged;
+    double pose_epsilon;
+    uint64_t num_skipped_updates;
+
+    // positions of the markers as get() returns them, see setSpatialIndex()
+    boost::scoped_ptr<SpatialGrid> spatial_index;
+  };
+
+  // the changes made by one call to applyChanges(), waiting to be published
+  struct UpdateBatch
+  {
+    uint64_t seq_num;
+    // shared with the marker state, they are never modified
+    std::vector<visualization_msgs::InteractiveMarkerConstPtr> markers;
+    std::vector<visualization_msgs::InteractiveMarkerPose> poses;
+    std::vector<std::string> erases;
+    // false if only group poses changed, which needs no update message
+    bool has_update;
+    // ends of the messages the update is split into, empty if it is not split.
+    // seq_num belongs to the last message, see setMaxMessageSize()
+    struct Split
+    {
+      size_t markers_end;
+      size_t poses_end;
+      size_t erases_end;
+    };
+    std::vector<Split> splits;
+    // groups whose pose changed
+    std::vector<std::string> group_frames;
+    std::vector<geometry_msgs::Pose> group_poses;
+    std::vector<std_msgs::Header> group_headers;
+    // the state the filtered topics select from, only kept if there were any
+    // when the batch was applied: the levels of detail of each marker, and
+    // the marker and its levels of detail behind each pose
+    bool filtered;
+    std::vector<LevelsOfDetailConstPtr> marker_levels_of_detail;
+    std::vector<visualization_msgs::InteractiveMarkerConstPtr> pose_markers;
+    std::vector<LevelsOfDetailConstPtr> pose_levels_of_detail;
+    // fulfilled once the update and the init message are out
+    boost::promise<void> published;
+  };
+
+  typedef boost::shared_ptr<UpdateBatch> UpdateBatchPtr;
+
+  // advertise & subscribe to the server topics
+  void init( const std::string &topic_ns, const std::string &server_id );
+
   // main loop when spinning our own thread
-  // - process callbacks in our callback queue
-  // - process pending goals
+  // - process callbacks in our callback queue as soon as they arrive
+  // - stop once the queue gets disabled
   void spinThread();
 
   // update marker pose & call user callback
   void processFeedback( const FeedbackConstPtr& feedback );
 
-  // send an empty update to keep the client GUIs happy
+  // Call a user callback after those that are running or waiting already.
+  // Feedback arrives through several subscriptions, which the threads of an
+  // executor may handle at the same time. The first thread calls back for
+  // all of them, the others return right away and never wait for it.
+  void dispatchFeedback( const FeedbackCallbackPtr& feedback_cb, const FeedbackConstPtr& feedback );
+
+  // send an empty update to keep the client GUIs happy,
+  // unless a real update went out during the last keep-alive period
   void keepAlive();
 
-  // increase sequence number & publish an update
-  void publish( visualization_msgs::InteractiveMarkerUpdate &update );
+  // the shard that holds the marker with the given name
+  MarkerShard& shardFor( const std::string &name ) const;
+
+  // main loop of the background publisher thread
+  void publishThread();
+
+  // Move the pending updates of all shards into the markers
+  // and start flush_timer_ if some of them are held back.
+  // (the caller must hold apply_mutex_)
+  // @param held_only  only apply updates held back by the maximum publish rate
+  // @return the applied changes, or an empty pointer if there were none
+  UpdateBatchPtr applyPendingUpdates( bool held_only = false );
+
+  // Move the pending updates of one shard into its markers and add them to batch.
+  // Pose updates that exceed the maximum publish rate stay pending.
+  // (the caller must hold apply_mutex_ and the shard lock exclusively)
+  // @param held_only         see above
+  // @param[in,out] next_release  lowered to when the first held update may go out
+  // @return false if there were no pending updates that could be applied
+  bool applyPendingUpdates( MarkerShard &shard, const ros::WallTime &now, bool held_only,
+      UpdateBatch &batch, ros::WallTime &next_release );
+
+  // publish the held updates whose interval has passed, called by flush_timer_
+  void flushHeldUpdates();
+
+  // minimum time between two pose updates of a marker, see setMaxPublishRate()
+  // (the caller must hold apply_mutex_)
+  ros::WallDuration getMinPublishInterval( const std::string &name ) const;
+
+  // Apply pending updates and queue them for the publisher thread
+  // (the caller must hold apply_mutex_)
+  boost::shared_future<void> queueUpdate( bool held_only = false );
+
+  // build and publish the update message for a batch
+  void publishUpdate( UpdateBatch &batch );
+
+  // publish one update message, with its poses separated if requested
+  // (the caller must hold publish_mutex_)
+  void publishUpdateMessage( const visualization_msgs::InteractiveMarkerUpdatePtr &update );
+
+  // split a batch into messages no larger than max_message_size_
+  // (the caller must hold apply_mutex_)
+  void splitBatch( UpdateBatch &batch ) const;
+
+  // end of the message that holds the first index changes of a batch,
+  // counting markers, poses and erases in that order
+  static UpdateBatch::Split splitAt( const UpdateBatch &batch, size_t index );
+
+  // publish the parts of the changes of a batch from begin to end, which
+  // went out with sequence number seq_num, selected by each filtered topic
+  // (the caller must hold publish_mutex_)
+  void publishFilteredUpdates( const UpdateBatch &batch, const UpdateBatch::Split &begin,
+      const UpdateBatch::Split &end, uint64_t seq_num );
+
+  // true if a marker in the given state is selected by filter
+  static bool matches( const InterestFilter &filter,
+      const std::string &name,
+      const std_msgs::Header &header,
+      const geometry_msgs::Pose &pose );
+
+  // publish an update with the last published sequence number
+  // (the caller must hold publish_mutex_)
+  void publish( const visualization_msgs::InteractiveMarkerUpdatePtr &update );
+
+  // broadcast the pose of every marker to tf
+  void publishTransforms();
+
+  // broadcast the frames of the given marker groups to tf
+  static void publishGroupTransforms( const std::vector<std::string> &group_frames,
+      const std::vector<geometry_msgs::Pose> &group_poses,
+      const std::vector<std_msgs::Header> &group_headers );
+
+  // get handles to all current markers
+  // (the caller must hold apply_mutex_)
+  void getMarkers( std::vector<visualization_msgs::InteractiveMarkerConstPtr> &int_markers ) const;
+
+  // publish the complete state to the latched "init" topic.
+  void publishInit( uint64_t seq_num, const std::vector<visualization_msgs::InteractiveMarkerConstPtr> &int_markers );
+
+  // add int_marker to markers, with the controls of its prototypes if expand is set
+  void addMarker( std::vector<visualization_msgs::InteractiveMarker> &markers,
+      const visualization_msgs::InteractiveMarker &int_marker, bool expand ) const;
 
-  // publish the current complete state to the latched "init" topic.
-  void publishInit();
+  // add int_marker to the markers of a filtered topic, at its level of detail
+  // and with the controls of its prototypes
+  void addFilteredMarker( std::vector<visualization_msgs::InteractiveMarker> &markers,
+      const visualization_msgs::InteractiveMarker &int_marker,
+      const LevelsOfDetailConstPtr &levels_of_detail,
+      const InterestFilter &filter ) const;
+
+  // decimate the large triangle lists of int_marker, NULL if there are none
+  LevelsOfDetailConstPtr makeLevelsOfDetail( const visualization_msgs::InteractiveMarker &int_marker ) const;
+
+  // the decimated controls of an applied marker, NULL if there are none
+  LevelsOfDetailConstPtr getLevelsOfDetail( const std::string &name ) const;
+
+  // true if markers go out with references to their prototypes
+  bool sharedPrototypes() const;
+
+  // publish all prototypes to the latched "prototypes" topic
+  // (the caller must hold prototypes_mutex_)
+  void publishPrototypes();
+
+  // publish init on the compressed "init" topic unless a newer state has
+  // replaced last_init_ in the meantime
+  // (the caller must not hold publish_mutex_)
+  void publishCompressedInit( const visualization_msgs::InteractiveMarkerInitConstPtr &init );
+
+  struct FilteredTopic;
+
+  // publish the selected part of the complete state to the "init" topic
+  // of a filtered topic and make it the markers its clients know about
+  // (the caller must hold publish_mutex_)
+  void publishFilteredInit( FilteredTopic &topic,
+      const std::vector<visualization_msgs::InteractiveMarkerConstPtr> &int_markers );
 
   // Update pose, schedule update without locking
-  void doSetPose( M_UpdateContext::iterator update_it,
+  void doSetPose( MarkerShard &shard,
+      M_UpdateContext::iterator update_it,
       const std::string &name,
       const geometry_msgs::Pose &pose,
       const std_msgs::Header &header );
 
-  // contains the current state of all markers
-  M_MarkerContext marker_contexts_;
+  // Get a handle as returned by get() without locking
+  static visualization_msgs::InteractiveMarkerConstPtr getHandle( const MarkerShard &shard, const std::string &name );
+
+  // add the current markers of a shard to its spatial index without locking
+  static void fillSpatialIndex( MarkerShard &shard );
 
-  // updates that have to be sent on the next publish
-  M_UpdateContext pending_updates_;
+  // Find the current state of a marker without locking.
+  // update is set if a pending pose or menu change applies to int_marker.
+  // @return false if the marker does not exist
+  static bool find( const MarkerShard &shard,
+      const std::string &name,
+      const UpdateContext* &update,
+      const visualization_msgs::InteractiveMarker* &int_marker );
+
+  // Apply the pose or menu change of a pending update to a copy of the marker
+  static void mergeUpdate( const UpdateContext &update,
+      visualization_msgs::InteractiveMarker &int_marker );
+
+  // The marker as it will be after applying the pending update, if its
+  // fingerprint is known. NULL otherwise. Does not lock.
+  static visualization_msgs::InteractiveMarkerPtr getFingerprinted( const MarkerShard &shard,
+      const std::string &name, size_t &fingerprint );
+
+  // Prepare a shared marker for modification, copying it
+  // if a handle returned by get() still refers to it
+  static visualization_msgs::InteractiveMarker& mutableMarker( visualization_msgs::InteractiveMarkerPtr &int_marker );
+
+  // Replace menu entries, schedule update without locking.
+  // update_it will point to the pending update afterwards.
+  static bool doSetMenuEntries( MarkerShard &shard,
+      M_MarkerContext::iterator marker_context_it,
+      M_UpdateContext::iterator &update_it,
+      const std::string &name,
+      const std::vector<visualization_msgs::MenuEntry> &menu_entries );
+
+  // Set callback for marker and pending update without locking
+  // @return false if the feedback type is unknown
+  static bool doSetCallback( MarkerShard &shard,
+      M_MarkerContext::iterator marker_context_it,
+      M_UpdateContext::iterator update_it,
+      const FeedbackCallbackPtr &feedback_cb,
+      uint8_t feedback_type );
+
+  // Return a table with one callback replaced.
+  // Remembers the last replacement in the shard, so that markers which had
+  // the same table before will share the resulting table as well.
+  static FeedbackCallbackTablePtr replaceCallback( MarkerShard &shard,
+      const FeedbackCallbackTablePtr &feedback_cbs,
+      const FeedbackCallbackPtr &feedback_cb,
+      uint8_t feedback_type );
+
+  // the markers, distributed by name
+  unsigned num_shards_;
+  boost::scoped_array<MarkerShard> shards_;
 
   // topic namespace to use
   std::string topic_ns_;
-  
-  boost::recursive_mutex mutex_;
 
-  // these are needed when spinning up a dedicated thread
+  // serializes applying changes and guards seq_num_ and the publish queue.
+  // Locks are taken in the order apply_mutex_, publish_mutex_, shard locks.
+  boost::mutex apply_mutex_;
+
+  // a tf frame broadcast for a group of markers, see setGroupPose()
+  struct MarkerGroup
+  {
+    geometry_msgs::Pose pose;
+    std_msgs::Header header;
+    // not broadcast since the last applyChanges()
+    bool changed;
+  };
+
+  typedef std::map< std::string, MarkerGroup > M_MarkerGroup;
+
+  // marker groups by frame. Taken after apply_mutex_ if both are needed.
+  M_MarkerGroup groups_;
+  mutable boost::shared_mutex groups_mutex_;
+
+  // minimum time between pose updates by name prefix, guarded by apply_mutex_
+  std::map<std::string, ros::WallDuration> min_publish_intervals_;
+
+  // publishes held pose updates if applyChanges() is not called again,
+  // guarded by apply_mutex_. flush_time_ is zero while it is not running.
+  ros::WallTimer flush_timer_;
+  ros::WallTime flush_time_;
+
+  // see setLevelsOfDetail(), sorted
+  std::vector<uint32_t> lod_max_points_;
+  mutable boost::mutex lod_mutex_;
+
+  // see setMaxMessageSize(), guarded by apply_mutex_
+  uint32_t max_message_size_;
+
+  // serializes publishing updates and guards published_seq_num_ and last_publish_time_
+  boost::mutex publish_mutex_;
+
+  // when the last update or keep-alive was sent
+  ros::Time last_publish_time_;
+
+  // applied changes waiting for the publisher thread
+  boost::scoped_ptr<boost::thread> publish_thread_;
+  std::deque<UpdateBatchPtr> publish_queue_;
+  boost::condition_variable publish_queue_cond_;
+  bool stop_publish_thread_;
+
+  // completes when everything applied so far has been published
+  boost::shared_future<void> last_published_;
+
+  // see setSeparatePoseTopic(), guarded by publish_mutex_
+  bool separate_poses_;
+  ros::Publisher pose_update_pub_;
+
+  // see setCompactPoses(), guarded by publish_mutex_
+  double compact_pose_resolution_;
+  ros::Publisher compact_pose_pub_;
+
+  // see addPrototype() and setSharedPrototypes(). Taken after all other locks.
+  M_Prototype prototypes_;
+  bool shared_prototypes_;
+  ros::Publisher prototypes_pub_;
+  mutable boost::shared_mutex prototypes_mutex_;
+
+  // see setCompressedInit(), guarded by publish_mutex_
+  ros::Publisher compressed_init_pub_;
+  visualization_msgs::InteractiveMarkerInitConstPtr last_init_;
+
+  // these are needed when spinning up a dedicated thread.
+  // Disabling the callback queue wakes up and terminates the thread.
   boost::scoped_ptr<boost::thread> spin_thread_;
   ros::NodeHandle node_handle_;
   ros::CallbackQueue callback_queue_;
-  volatile bool need_to_terminate_;
 
   // this is needed when running in non-threaded mode
   ros::Timer keep_alive_timer_;
 
+  // runs our callbacks if the server shares one, otherwise NULL
+  InteractiveMarkerExecutor* executor_;
+
+  // topics carrying the markers selected by one filter, see addFilteredTopic()
+  struct FilteredTopic
+  {
+    InterestFilter filter;
+    ros::Publisher init_pub;
+    ros::Publisher update_pub;
+    ros::Subscriber feedback_sub;
+    // sequence number of this topic, which only counts its own updates
+    uint64_t seq_num;
+    // server sequence number covered by the init message the topic started
+    // with. Updates applied before that are not sent.
+    uint64_t first_seq_num;
+    ros::Time last_publish_time;
+    // markers that the clients of this topic know about
+    std::set<std::string> visible;
+  };
+
+  typedef boost::shared_ptr<FilteredTopic> FilteredTopicPtr;
+  typedef std::map< std::string, FilteredTopicPtr > M_FilteredTopic;
+
+  // filtered topics by namespace, guarded by publish_mutex_.
+  // Added and removed with apply_mutex_ held as well.
+  M_FilteredTopic filtered_topics_;
+
   ros::Publisher init_pub_;
   ros::Publisher update_pub_;
   ros::Subscriber feedback_sub_;
 
+  // user callbacks waiting for dispatchFeedback(), guarded by feedback_mutex_
+  std::deque< std::pair<FeedbackCallbackPtr, FeedbackConstPtr> > feedback_queue_;
+  bool dispatching_feedback_;
+  boost::mutex feedback_mutex_;
+
+  // sequence number of the last applied and the last published update
   uint64_t seq_num_;
+  uint64_t published_seq_num_;
 
   std::string server_id_;
 };
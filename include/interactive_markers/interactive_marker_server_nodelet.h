@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INTERACTIVE_MARKER_SERVER_NODELET
+#define INTERACTIVE_MARKER_SERVER_NODELET
+
+#include <nodelet/nodelet.h>
+
+#include <interactive_markers/interactive_marker_executor.h>
+#include <interactive_markers/interactive_marker_server.h>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace interactive_markers
+{
+
+/// Base class for nodelets that provide interactive markers.
+///
+/// All server nodelets loaded into the same nodelet manager share one
+/// InteractiveMarkerExecutor, and their updates are passed to subscribers in
+/// the same manager as pointers instead of being serialized.
+///
+/// Private parameters:
+/// - ~topic_ns      Topic namespace of the server (default: the nodelet name)
+/// - ~server_id     Server id (default: the nodelet name without its namespace)
+/// - ~num_shards    Number of independently locked parts of the server (default: 1)
+class InteractiveMarkerServerNodelet : public nodelet::Nodelet
+{
+public:
+  /// Destroys the server before the shared executor is released.
+  virtual ~InteractiveMarkerServerNodelet();
+
+protected:
+
+  /// Called once the server has been created.
+  /// Insert markers and set up timers or subscriptions here.
+  virtual void onInitServer() = 0;
+
+  /// @return the server of this nodelet
+  InteractiveMarkerServer& getServer();
+
+private:
+
+  virtual void onInit();
+
+  boost::shared_ptr<InteractiveMarkerExecutor> executor_;
+  boost::scoped_ptr<InteractiveMarkerServer> server_;
+};
+
+}
+
+#endif
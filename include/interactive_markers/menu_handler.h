@@ -121,6 +121,10 @@ private:
                         std::vector<visualization_msgs::MenuEntry>& entries_out,
                         EntryHandle parent_handle );
 
+  // Return the flattened menu, rebuilding it if the menu has changed
+  // since the last call.
+  const std::vector<visualization_msgs::MenuEntry>& getMenuEntries();
+
   visualization_msgs::MenuEntry makeEntry( EntryContext& context, EntryHandle handle, EntryHandle parent_handle );
 
   // Insert without adding a top-level entry
@@ -136,6 +140,10 @@ private:
   EntryHandle current_handle_;
 
   std::set<std::string> managed_markers_;
+
+  // flattened menu, valid as long as menu_entries_dirty_ is false
+  std::vector<visualization_msgs::MenuEntry> menu_entries_;
+  bool menu_entries_dirty_;
 };
 
 }
@@ -41,6 +41,31 @@ namespace interactive_markers
  * @param msg      interactive marker to be completed */
 void autoComplete( visualization_msgs::InteractiveMarker &msg );
 
+/// Options for completing a batch of interactive markers
+struct AutoCompleteOptions
+{
+  AutoCompleteOptions() : num_threads(0), min_batch_size(64) {}
+
+  /// Number of threads working on the batch, including the calling one.
+  /// 0 means one per hardware thread. The worker threads are started
+  /// once and shared by all calls.
+  unsigned num_threads;
+
+  /// Minimum number of markers handed to one worker thread.
+  /// Batches smaller than this are completed on the calling thread.
+  unsigned min_batch_size;
+};
+
+/** @brief fill in default values & insert default controls for a batch of markers.
+ *
+ * The work is spread over a pool of worker threads. The result is the same
+ * as calling autoComplete( visualization_msgs::InteractiveMarker &msg ) on
+ * each marker in order, independent of the number of threads used.
+ * @param msgs     interactive markers to be completed
+ * @param options  controls how the work is distributed */
+void autoComplete( std::vector<visualization_msgs::InteractiveMarker> &msgs,
+    const AutoCompleteOptions &options = AutoCompleteOptions() );
+
 /// @brief fill in default values & insert default controls when none are specified
 /// @param msg      interactive marker which contains the control
 /// @param control  the control to be completed
@@ -53,6 +78,14 @@ void autoComplete( const visualization_msgs::InteractiveMarker &msg,
  * This is called by autoComplete( visualization_msgs::InteractiveMarker &msg ). */
 void uniqueifyControlNames( visualization_msgs::InteractiveMarker& msg );
 
+/// @brief make an interactive marker use the controls of a prototype.
+///
+/// The prototype needs to be registered with InteractiveMarkerServer::addPrototype().
+/// Its controls are added to those of the marker when it reaches a client.
+/// @param msg        interactive marker to add the reference to
+/// @param prototype  name of the prototype
+void usePrototype( visualization_msgs::InteractiveMarker &msg, const std::string &prototype );
+
 /// make a quaternion with a fixed local x axis.
 /// The rotation around that axis will be chosen automatically.
 /// @param x,y,z    the designated x axis
@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "interactive_markers/detail/compact_poses.h"
+
+#include <algorithm>
+#include <map>
+#include <math.h>
+#include <string.h>
+
+namespace interactive_markers
+{
+
+namespace
+{
+
+// first byte of every message, bump when the layout changes
+const uint8_t FORMAT_VERSION = 1;
+
+// bits per quaternion component in the smallest-three encoding.
+// An even number of steps makes 0 exact, so rotations about one axis stay clean.
+const unsigned QUATERNION_BITS = 10;
+const uint32_t QUATERNION_MAX = ( 1u << QUATERNION_BITS ) - 2;
+const uint32_t QUATERNION_MASK = ( 1u << QUATERNION_BITS ) - 1;
+
+// the three smallest components of a unit quaternion lie within +-1/sqrt(2)
+const double QUATERNION_RANGE = M_SQRT1_2;
+
+class Writer
+{
+public:
+  Writer( std::vector<uint8_t> &data ) : data_( data ) {}
+
+  void writeByte( uint8_t value )
+  {
+    data_.push_back( value );
+  }
+
+  void writeUint32( uint32_t value )
+  {
+    for ( int i = 0; i < 4; i++ )
+    {
+      data_.push_back( ( value >> ( 8 * i ) ) & 0xff );
+    }
+  }
+
+  void writeDouble( double value )
+  {
+    uint64_t bits;
+    memcpy( &bits, &value, sizeof( bits ) );
+    writeUint32( bits & 0xffffffff );
+    writeUint32( bits >> 32 );
+  }
+
+  // 7 bits per byte, small values take one byte
+  void writeVarint( uint64_t value )
+  {
+    while ( value >= 0x80 )
+    {
+      data_.push_back( ( value & 0x7f ) | 0x80 );
+      value >>= 7;
+    }
+    data_.push_back( value );
+  }
+
+  // zigzag encoding keeps small negative values short as well
+  void writeSignedVarint( int64_t value )
+  {
+    writeVarint( ( uint64_t( value ) << 1 ) ^ uint64_t( value >> 63 ) );
+  }
+
+  void writeString( const std::string &value )
+  {
+    writeVarint( value.size() );
+    data_.insert( data_.end(), value.begin(), value.end() );
+  }
+
+private:
+  std::vector<uint8_t> &data_;
+};
+
+// reads until the data runs out, after which ok() is false
+class Reader
+{
+public:
+  Reader( const std::vector<uint8_t> &data ) : data_( data ), pos_( 0 ), ok_( true ) {}
+
+  bool ok() const
+  {
+    return ok_;
+  }
+
+  bool atEnd() const
+  {
+    return pos_ == data_.size();
+  }
+
+  uint8_t readByte()
+  {
+    if ( !ok_ || pos_ >= data_.size() )
+    {
+      ok_ = false;
+      return 0;
+    }
+    return data_[pos_++];
+  }
+
+  uint32_t readUint32()
+  {
+    uint32_t value = 0;
+    for ( int i = 0; i < 4; i++ )
+    {
+      value |= uint32_t( readByte() ) << ( 8 * i );
+    }
+    return value;
+  }
+
+  double readDouble()
+  {
+    uint64_t bits = readUint32();
+    bits |= uint64_t( readUint32() ) << 32;
+    double value;
+    memcpy( &value, &bits, sizeof( value ) );
+    return value;
+  }
+
+  uint64_t readVarint()
+  {
+    uint64_t value = 0;
+    for ( unsigned shift = 0; shift < 64; shift += 7 )
+    {
+      uint8_t byte = readByte();
+      value |= uint64_t( byte & 0x7f ) << shift;
+      if ( !( byte & 0x80 ) )
+      {
+        return value;
+      }
+    }
+    ok_ = false;
+    return 0;
+  }
+
+  int64_t readSignedVarint()
+  {
+    uint64_t value = readVarint();
+    return int64_t( value >> 1 ) ^ -int64_t( value & 1 );
+  }
+
+  std::string readString()
+  {
+    uint64_t size = readVarint();
+    if ( !ok_ || size > data_.size() - pos_ )
+    {
+      ok_ = false;
+      return std::string();
+    }
+    std::string value( data_.begin() + pos_, data_.begin() + pos_ + size );
+    pos_ += size;
+    return value;
+  }
+
+  // for sizes of tables, which cannot exceed the remaining bytes
+  size_t readCount()
+  {
+    uint64_t count = readVarint();
+    if ( count > data_.size() - pos_ )
+    {
+      ok_ = false;
+      return 0;
+    }
+    return count;
+  }
+
+private:
+  const std::vector<uint8_t> &data_;
+  size_t pos_;
+  bool ok_;
+};
+
+uint32_t encodeQuaternion( const geometry_msgs::Quaternion &orientation )
+{
+  double q[4] = { orientation.x, orientation.y, orientation.z, orientation.w };
+
+  double norm = sqrt( q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3] );
+  if ( norm == 0.0 )
+  {
+    // an unset orientation is the identity, as in autoComplete()
+    q[3] = norm = 1.0;
+  }
+
+  unsigned largest = 0;
+  for ( unsigned i = 1; i < 4; i++ )
+  {
+    if ( fabs( q[i] ) > fabs( q[largest] ) )
+    {
+      largest = i;
+    }
+  }
+
+  // q and -q are the same rotation, so make the dropped component positive
+  double sign = q[largest] < 0.0 ? -1.0 : 1.0;
+
+  uint32_t bits = largest;
+  for ( unsigned i = 0; i < 4; i++ )
+  {
+    if ( i == largest )
+    {
+      continue;
+    }
+    double value = sign * q[i] / norm;
+    double scaled = ( value + QUATERNION_RANGE ) / ( 2.0 * QUATERNION_RANGE ) * QUATERNION_MAX;
+    uint32_t quantized = std::min<double>( std::max( floor( scaled + 0.5 ), 0.0 ), QUATERNION_MAX );
+    bits = ( bits << QUATERNION_BITS ) | quantized;
+  }
+  return bits;
+}
+
+geometry_msgs::Quaternion decodeQuaternion( uint32_t bits )
+{
+  double q[4];
+  unsigned largest = ( bits >> ( 3 * QUATERNION_BITS ) ) & 3;
+
+  double sum = 0.0;
+  for ( int i = 3; i >= 0; i-- )
+  {
+    if ( unsigned( i ) == largest )
+    {
+      continue;
+    }
+    double quantized = std::min( bits & QUATERNION_MASK, QUATERNION_MAX );
+    bits >>= QUATERNION_BITS;
+    q[i] = quantized / QUATERNION_MAX * ( 2.0 * QUATERNION_RANGE ) - QUATERNION_RANGE;
+    sum += q[i] * q[i];
+  }
+  q[largest] = sqrt( std::max( 1.0 - sum, 0.0 ) );
+
+  geometry_msgs::Quaternion orientation;
+  orientation.x = q[0];
+  orientation.y = q[1];
+  orientation.z = q[2];
+  orientation.w = q[3];
+  return orientation;
+}
+
+}
+
+void encodeCompactPoses( const visualization_msgs::InteractiveMarkerUpdate &update,
+    double resolution, std::vector<uint8_t> &data )
+{
+  // number the distinct headers in the order they appear
+  typedef std::map< std::pair<std::string, std::pair<uint32_t, uint32_t> >, size_t > M_HeaderIndex;
+  M_HeaderIndex header_indices;
+  std::vector<const std_msgs::Header*> headers;
+  std::vector<size_t> pose_headers( update.poses.size() );
+  for ( size_t i = 0; i < update.poses.size(); i++ )
+  {
+    const std_msgs::Header &header = update.poses[i].header;
+    M_HeaderIndex::key_type key( header.frame_id, std::make_pair( header.stamp.sec, header.stamp.nsec ) );
+    std::pair<M_HeaderIndex::iterator, bool> inserted = header_indices.insert( std::make_pair( key, headers.size() ) );
+    if ( inserted.second )
+    {
+      headers.push_back( &header );
+    }
+    pose_headers[i] = inserted.first->second;
+  }
+
+  data.clear();
+  Writer writer( data );
+  writer.writeByte( FORMAT_VERSION );
+  writer.writeString( update.server_id );
+  writer.writeVarint( update.seq_num );
+  writer.writeDouble( resolution );
+
+  writer.writeVarint( headers.size() );
+  for ( size_t i = 0; i < headers.size(); i++ )
+  {
+    writer.writeString( headers[i]->frame_id );
+    writer.writeUint32( headers[i]->stamp.sec );
+    writer.writeUint32( headers[i]->stamp.nsec );
+  }
+
+  writer.writeVarint( update.poses.size() );
+  for ( size_t i = 0; i < update.poses.size(); i++ )
+  {
+    const visualization_msgs::InteractiveMarkerPose &pose = update.poses[i];
+    writer.writeString( pose.name );
+    writer.writeVarint( pose_headers[i] );
+    writer.writeSignedVarint( llround( pose.pose.position.x / resolution ) );
+    writer.writeSignedVarint( llround( pose.pose.position.y / resolution ) );
+    writer.writeSignedVarint( llround( pose.pose.position.z / resolution ) );
+    writer.writeUint32( encodeQuaternion( pose.pose.orientation ) );
+  }
+}
+
+bool decodeCompactPoses( const std::vector<uint8_t> &data,
+    visualization_msgs::InteractiveMarkerUpdate &update )
+{
+  Reader reader( data );
+  if ( reader.readByte() != FORMAT_VERSION )
+  {
+    return false;
+  }
+
+  update.type = visualization_msgs::InteractiveMarkerUpdate::UPDATE;
+  update.server_id = reader.readString();
+  update.seq_num = reader.readVarint();
+  double resolution = reader.readDouble();
+
+  std::vector<std_msgs::Header> headers( reader.readCount() );
+  for ( size_t i = 0; i < headers.size(); i++ )
+  {
+    headers[i].frame_id = reader.readString();
+    uint32_t sec = reader.readUint32();
+    uint32_t nsec = reader.readUint32();
+    headers[i].stamp = ros::Time( sec, nsec );
+  }
+
+  update.poses.resize( reader.readCount() );
+  for ( size_t i = 0; i < update.poses.size() && reader.ok(); i++ )
+  {
+    visualization_msgs::InteractiveMarkerPose &pose = update.poses[i];
+    pose.name = reader.readString();
+    uint64_t header_index = reader.readVarint();
+    if ( header_index >= headers.size() )
+    {
+      return false;
+    }
+    pose.header = headers[header_index];
+    pose.pose.position.x = reader.readSignedVarint() * resolution;
+    pose.pose.position.y = reader.readSignedVarint() * resolution;
+    pose.pose.position.z = reader.readSignedVarint() * resolution;
+    pose.pose.orientation = decodeQuaternion( reader.readUint32() );
+  }
+
+  return reader.ok() && reader.atEnd();
+}
+
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "interactive_markers/detail/compressed_init.h"
+
+#include <ros/serialization.h>
+
+#include <zlib.h>
+
+namespace interactive_markers
+{
+
+// bytes in front of the zlib stream
+const size_t HEADER_SIZE = 4;
+
+// deflate cannot compress better than this, so larger sizes in the header are corrupt
+const size_t MAX_COMPRESSION_RATIO = 1032;
+
+bool compressInit( const visualization_msgs::InteractiveMarkerInit &init,
+    std::vector<uint8_t> &data, int level )
+{
+  // never empty, the message has at least its fixed size fields
+  uint32_t length = ros::serialization::serializationLength( init );
+  std::vector<uint8_t> buffer( length );
+  ros::serialization::OStream stream( &buffer[0], length );
+  ros::serialization::serialize( stream, init );
+
+  uLongf compressed_length = compressBound( length );
+  data.resize( HEADER_SIZE + compressed_length );
+  for ( size_t i = 0; i < HEADER_SIZE; i++ )
+  {
+    data[i] = ( length >> ( 8 * i ) ) & 0xff;
+  }
+
+  if ( compress2( &data[HEADER_SIZE], &compressed_length, &buffer[0], length, level ) != Z_OK )
+  {
+    data.clear();
+    return false;
+  }
+
+  data.resize( HEADER_SIZE + compressed_length );
+  return true;
+}
+
+bool decompressInit( const std::vector<uint8_t> &data,
+    visualization_msgs::InteractiveMarkerInit &init )
+{
+  if ( data.size() <= HEADER_SIZE )
+  {
+    return false;
+  }
+
+  uint32_t length = 0;
+  for ( size_t i = 0; i < HEADER_SIZE; i++ )
+  {
+    length |= uint32_t( data[i] ) << ( 8 * i );
+  }
+
+  if ( length == 0 || length / MAX_COMPRESSION_RATIO > data.size() - HEADER_SIZE )
+  {
+    return false;
+  }
+
+  std::vector<uint8_t> buffer( length );
+  uLongf uncompressed_length = length;
+  if ( uncompress( &buffer[0], &uncompressed_length, &data[HEADER_SIZE], data.size() - HEADER_SIZE ) != Z_OK ||
+       uncompressed_length != length )
+  {
+    return false;
+  }
+
+  try
+  {
+    ros::serialization::IStream stream( &buffer[0], length );
+    ros::serialization::deserialize( stream, init );
+  }
+  catch ( ros::serialization::StreamOverrunException& )
+  {
+    return false;
+  }
+  return true;
+}
+
+}
@@ -31,6 +31,8 @@
 
 #include "interactive_markers/interactive_marker_client.h"
 #include "interactive_markers/detail/single_client.h"
+#include "interactive_markers/detail/compact_poses.h"
+#include "interactive_markers/detail/compressed_init.h"
 
 #include <boost/bind.hpp>
 #include <boost/make_shared.hpp>
@@ -42,6 +44,10 @@
 namespace interactive_markers
 {
 
+// how long to wait for compressed init messages before falling back
+// to the plain topic if only some servers publish them
+const double COMPRESSED_INIT_TIMEOUT = 1.0;
+
 InteractiveMarkerClient::InteractiveMarkerClient(
     tf::Transformer& tf,
     const std::string& target_frame,
@@ -120,8 +126,13 @@ void InteractiveMarkerClient::shutdown()
   case INIT:
   case RUNNING:
     publisher_contexts_.clear();
+    prototypes_.clear();
+    prototypes_sub_.shutdown();
     init_sub_.shutdown();
+    compressed_init_sub_.shutdown();
     update_sub_.shutdown();
+    pose_update_sub_.shutdown();
+    compact_pose_update_sub_.shutdown();
     last_num_publishers_=0;
     state_=IDLE;
     break;
@@ -136,6 +147,9 @@ void InteractiveMarkerClient::subscribeUpdate()
     {
       update_sub_ = nh_.subscribe( topic_ns_+"/update", 100, &InteractiveMarkerClient::processUpdate, this );
       DBG_MSG( "Subscribed to update topic: %s", (topic_ns_+"/update").c_str() );
+      pose_update_sub_ = nh_.subscribe( topic_ns_+"/update_poses", 100, &InteractiveMarkerClient::processPoseUpdate, this );
+      compact_pose_update_sub_ = nh_.subscribe( topic_ns_+"/update_poses_compact", 100, &InteractiveMarkerClient::processCompactPoseUpdate, this );
+      prototypes_sub_ = nh_.subscribe( topic_ns_+"/prototypes", 100, &InteractiveMarkerClient::processPrototypes, this );
     }
     catch( ros::Exception& e )
     {
@@ -149,12 +163,31 @@ void InteractiveMarkerClient::subscribeUpdate()
 void InteractiveMarkerClient::subscribeInit()
 {
   if ( state_ != INIT && !topic_ns_.empty() )
+  {
+    // the plain topic is only added by update() for servers that turn out
+    // not to publish a compressed state
+    try
+    {
+      compressed_init_sub_ = nh_.subscribe( topic_ns_+"/update_full_compressed", 100, &InteractiveMarkerClient::processCompressedInit, this );
+      DBG_MSG( "Subscribed to init topic: %s", (topic_ns_+"/update_full_compressed").c_str() );
+      init_subscribe_time_ = ros::WallTime::now();
+      state_ = INIT;
+    }
+    catch( ros::Exception& e )
+    {
+      callbacks_.statusCb( ERROR, "General", "Error subscribing: " + std::string(e.what()) );
+    }
+  }
+}
+
+void InteractiveMarkerClient::subscribePlainInit()
+{
+  if ( !init_sub_ && !topic_ns_.empty() )
   {
     try
     {
       init_sub_ = nh_.subscribe( topic_ns_+"/update_full", 100, &InteractiveMarkerClient::processInit, this );
       DBG_MSG( "Subscribed to init topic: %s", (topic_ns_+"/update_full").c_str() );
-      state_ = INIT;
     }
     catch( ros::Exception& e )
     {
@@ -184,7 +217,7 @@ void InteractiveMarkerClient::process( const MsgConstPtrT& msg )
   {
     DBG_MSG( "New publisher detected: %s", msg->server_id.c_str() );
 
-    SingleClientPtr pc(new SingleClient( msg->server_id, tf_, target_frame_, callbacks_ ));
+    SingleClientPtr pc(new SingleClient( msg->server_id, tf_, target_frame_, callbacks_, prototypes_[msg->server_id] ));
     context_it = publisher_contexts_.insert( std::make_pair(msg->server_id,pc) ).first;
 
     // we need to subscribe to the init topic again
@@ -200,11 +233,63 @@ void InteractiveMarkerClient::processInit( const InitConstPtr& msg )
   process<InitConstPtr>(msg);
 }
 
+void InteractiveMarkerClient::processCompressedInit( const std_msgs::UInt8MultiArrayConstPtr& msg )
+{
+  visualization_msgs::InteractiveMarkerInitPtr init =
+      boost::make_shared<visualization_msgs::InteractiveMarkerInit>();
+  if ( !decompressInit( msg->data, *init ) )
+  {
+    callbacks_.statusCb( ERROR, "General", "Received a corrupt compressed init message." );
+    return;
+  }
+  process<InitConstPtr>(init);
+
+  // the raw snapshot is not needed as long as every server compresses
+  if ( init_sub_ && update_sub_.getNumPublishers() <= compressed_init_sub_.getNumPublishers() )
+  {
+    DBG_MSG( "Received a compressed init, unsubscribing from %s", (topic_ns_+"/update_full").c_str() );
+    init_sub_.shutdown();
+  }
+}
+
 void InteractiveMarkerClient::processUpdate( const UpdateConstPtr& msg )
 {
   process<UpdateConstPtr>(msg);
 }
 
+void InteractiveMarkerClient::processPoseUpdate( const UpdateConstPtr& msg )
+{
+  // the update channel announces new servers
+  M_SingleClient::iterator context_it = publisher_contexts_.find(msg->server_id);
+  if ( context_it != publisher_contexts_.end() )
+  {
+    context_it->second->processPoses( msg );
+  }
+}
+
+void InteractiveMarkerClient::processPrototypes( const InitConstPtr& msg )
+{
+  // prototypes never change, so the latest message adds to the ones we know.
+  // Markers waiting for them are expanded on the next update().
+  M_Prototype& prototypes = prototypes_[msg->server_id];
+  for ( size_t i = 0; i < msg->markers.size(); i++ )
+  {
+    prototypes[ msg->markers[i].name ] = msg->markers[i].controls;
+  }
+}
+
+void InteractiveMarkerClient::processCompactPoseUpdate( const std_msgs::UInt8MultiArrayConstPtr& msg )
+{
+  visualization_msgs::InteractiveMarkerUpdatePtr update =
+      boost::make_shared<visualization_msgs::InteractiveMarkerUpdate>();
+  if ( !decodeCompactPoses( msg->data, *update ) )
+  {
+    callbacks_.statusCb( ERROR, "General", "Received a corrupt compact pose message." );
+    return;
+  }
+  processPoseUpdate( update );
+}
+
 void InteractiveMarkerClient::update()
 {
   switch ( state_ )
@@ -240,8 +325,19 @@ void InteractiveMarkerClient::update()
     if ( state_ == INIT && initialized )
     {
       init_sub_.shutdown();
+      compressed_init_sub_.shutdown();
       state_ = RUNNING;
     }
+    if ( state_ == INIT && !init_sub_ )
+    {
+      // some servers publish updates but no compressed state. Publisher
+      // counts are not reliable right after subscribing, so give them time.
+      bool timed_out = ( ros::WallTime::now() - init_subscribe_time_ ).toSec() > COMPRESSED_INIT_TIMEOUT;
+      if ( timed_out && update_sub_.getNumPublishers() > compressed_init_sub_.getNumPublishers() )
+      {
+        subscribePlainInit();
+      }
+    }
     if ( state_ == RUNNING && !initialized )
     {
       subscribeInit();
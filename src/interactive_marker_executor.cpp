@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "interactive_markers/interactive_marker_executor.h"
+#include "interactive_markers/interactive_marker_server.h"
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+
+namespace interactive_markers
+{
+
+InteractiveMarkerExecutor::InteractiveMarkerExecutor( unsigned num_threads ) :
+    num_threads_( num_threads )
+{
+  if ( num_threads_ == 0 )
+  {
+    num_threads_ = std::max( boost::thread::hardware_concurrency(), 1u );
+  }
+
+  node_handle_.setCallbackQueue( &callback_queue_ );
+  keep_alive_timer_ = node_handle_.createTimer( ros::Duration( InteractiveMarkerServer::KEEP_ALIVE_PERIOD ), boost::bind( &InteractiveMarkerExecutor::keepAlive, this ) );
+
+  for ( unsigned i = 0; i < num_threads_; i++ )
+  {
+    worker_threads_.create_thread( boost::bind( &InteractiveMarkerExecutor::workerThread, this ) );
+  }
+}
+
+
+InteractiveMarkerExecutor::~InteractiveMarkerExecutor()
+{
+  keep_alive_timer_.stop();
+  callback_queue_.disable();
+  worker_threads_.join_all();
+}
+
+
+unsigned InteractiveMarkerExecutor::getNumThreads() const
+{
+  return num_threads_;
+}
+
+
+ros::CallbackQueue* InteractiveMarkerExecutor::getCallbackQueue()
+{
+  return &callback_queue_;
+}
+
+
+void InteractiveMarkerExecutor::addKeepAlive( const void* owner, const boost::function<void ()> &keep_alive_cb )
+{
+  boost::mutex::scoped_lock lock( keep_alive_mutex_ );
+  keep_alive_cbs_[owner] = keep_alive_cb;
+}
+
+
+void InteractiveMarkerExecutor::removeKeepAlive( const void* owner )
+{
+  boost::mutex::scoped_lock lock( keep_alive_mutex_ );
+  keep_alive_cbs_.erase( owner );
+}
+
+
+void InteractiveMarkerExecutor::workerThread()
+{
+  // several threads may wait on the same queue. roscpp hands out the
+  // callbacks of one subscription to only one of them at a time.
+  while ( node_handle_.ok() && callback_queue_.isEnabled() )
+  {
+    callback_queue_.callAvailable( ros::WallDuration( 0.1 ) );
+  }
+}
+
+
+void InteractiveMarkerExecutor::keepAlive()
+{
+  boost::mutex::scoped_lock lock( keep_alive_mutex_ );
+
+  std::map< const void*, boost::function<void ()> >::iterator it;
+  for ( it = keep_alive_cbs_.begin(); it != keep_alive_cbs_.end(); it++ )
+  {
+    it->second();
+  }
+}
+
+}
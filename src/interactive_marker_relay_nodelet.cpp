@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Forwards the topics of an interactive marker server to another
+// namespace and the feedback back to the server. Messages are passed on
+// as received, so nothing is copied within a nodelet manager.
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+#include <std_msgs/UInt8MultiArray.h>
+#include <visualization_msgs/InteractiveMarkerFeedback.h>
+#include <visualization_msgs/InteractiveMarkerInit.h>
+#include <visualization_msgs/InteractiveMarkerUpdate.h>
+
+namespace interactive_markers
+{
+
+/// Private parameters:
+/// - ~upstream_ns   Topic namespace of the server to forward
+/// - ~topic_ns      Topic namespace to forward to (default: the nodelet name)
+class InteractiveMarkerRelayNodelet : public nodelet::Nodelet
+{
+private:
+
+  virtual void onInit()
+  {
+    ros::NodeHandle& nh = getMTNodeHandle();
+    ros::NodeHandle& private_nh = getPrivateNodeHandle();
+
+    std::string upstream_ns;
+    std::string topic_ns;
+    if ( !private_nh.getParam( "upstream_ns", upstream_ns ) )
+    {
+      NODELET_ERROR( "Parameter ~upstream_ns is not set, not relaying anything." );
+      return;
+    }
+    private_nh.param<std::string>( "topic_ns", topic_ns, getName() );
+
+    init_pub_ = nh.advertise<visualization_msgs::InteractiveMarkerInit>( topic_ns + "/update_full", 100, true );
+    compressed_init_pub_ = nh.advertise<std_msgs::UInt8MultiArray>( topic_ns + "/update_full_compressed", 100, true );
+    prototypes_pub_ = nh.advertise<visualization_msgs::InteractiveMarkerInit>( topic_ns + "/prototypes", 100, true );
+    update_pub_ = nh.advertise<visualization_msgs::InteractiveMarkerUpdate>( topic_ns + "/update", 100 );
+    pose_update_pub_ = nh.advertise<visualization_msgs::InteractiveMarkerUpdate>( topic_ns + "/update_poses", 100 );
+    compact_pose_update_pub_ = nh.advertise<std_msgs::UInt8MultiArray>( topic_ns + "/update_poses_compact", 100 );
+    feedback_pub_ = nh.advertise<visualization_msgs::InteractiveMarkerFeedback>( upstream_ns + "/feedback", 100 );
+
+    init_sub_ = nh.subscribe( upstream_ns + "/update_full", 100, &InteractiveMarkerRelayNodelet::initCb, this );
+    compressed_init_sub_ = nh.subscribe( upstream_ns + "/update_full_compressed", 100,
+        &InteractiveMarkerRelayNodelet::compressedInitCb, this );
+    prototypes_sub_ = nh.subscribe( upstream_ns + "/prototypes", 100, &InteractiveMarkerRelayNodelet::prototypesCb, this );
+    update_sub_ = nh.subscribe( upstream_ns + "/update", 100, &InteractiveMarkerRelayNodelet::updateCb, this );
+    pose_update_sub_ = nh.subscribe( upstream_ns + "/update_poses", 100, &InteractiveMarkerRelayNodelet::poseUpdateCb, this );
+    compact_pose_update_sub_ = nh.subscribe( upstream_ns + "/update_poses_compact", 100,
+        &InteractiveMarkerRelayNodelet::compactPoseUpdateCb, this );
+    feedback_sub_ = nh.subscribe( topic_ns + "/feedback", 100, &InteractiveMarkerRelayNodelet::feedbackCb, this );
+
+    NODELET_INFO( "Relaying interactive markers from %s to %s", upstream_ns.c_str(), topic_ns.c_str() );
+  }
+
+  void initCb( const visualization_msgs::InteractiveMarkerInitConstPtr& msg )
+  {
+    init_pub_.publish( msg );
+  }
+
+  void compressedInitCb( const std_msgs::UInt8MultiArrayConstPtr& msg )
+  {
+    compressed_init_pub_.publish( msg );
+  }
+
+  void prototypesCb( const visualization_msgs::InteractiveMarkerInitConstPtr& msg )
+  {
+    prototypes_pub_.publish( msg );
+  }
+
+  void updateCb( const visualization_msgs::InteractiveMarkerUpdateConstPtr& msg )
+  {
+    update_pub_.publish( msg );
+  }
+
+  void poseUpdateCb( const visualization_msgs::InteractiveMarkerUpdateConstPtr& msg )
+  {
+    pose_update_pub_.publish( msg );
+  }
+
+  void compactPoseUpdateCb( const std_msgs::UInt8MultiArrayConstPtr& msg )
+  {
+    compact_pose_update_pub_.publish( msg );
+  }
+
+  void feedbackCb( const visualization_msgs::InteractiveMarkerFeedbackConstPtr& msg )
+  {
+    feedback_pub_.publish( msg );
+  }
+
+  ros::Publisher init_pub_;
+  ros::Publisher compressed_init_pub_;
+  ros::Publisher prototypes_pub_;
+  ros::Publisher update_pub_;
+  ros::Publisher pose_update_pub_;
+  ros::Publisher compact_pose_update_pub_;
+  ros::Publisher feedback_pub_;
+
+  ros::Subscriber init_sub_;
+  ros::Subscriber compressed_init_sub_;
+  ros::Subscriber prototypes_sub_;
+  ros::Subscriber update_sub_;
+  ros::Subscriber pose_update_sub_;
+  ros::Subscriber compact_pose_update_sub_;
+  ros::Subscriber feedback_sub_;
+};
+
+}
+
+PLUGINLIB_EXPORT_CLASS( interactive_markers::InteractiveMarkerRelayNodelet, nodelet::Nodelet )
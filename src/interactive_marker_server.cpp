@@ -30,19 +30,85 @@
  */
 
 #include "interactive_markers/interactive_marker_server.h"
+#include "interactive_markers/detail/compact_poses.h"
+#include "interactive_markers/detail/compressed_init.h"
+#include "interactive_markers/detail/mesh_decimation.h"
 
-#include <visualization_msgs/InteractiveMarkerInit.h>
+#include <std_msgs/UInt8MultiArray.h>
 #include <tf/transform_broadcaster.h>
+#include <tf/tf.h>
+
+#include <ros/serialization.h>
 
 #include <boost/bind.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/make_shared.hpp>
 
+#include <algorithm>
+#include <math.h>
+
 namespace interactive_markers
 {
 
-InteractiveMarkerServer::InteractiveMarkerServer( const std::string &topic_ns, const std::string &server_id, bool spin_thread ) :
+// clients complain if they do not receive anything for 2 seconds
+const double InteractiveMarkerServer::KEEP_ALIVE_PERIOD = 0.5;
+
+// the state is compressed on the publisher thread, so favour speed over size
+const int INIT_COMPRESSION_LEVEL = 1;
+
+namespace
+{
+
+void serializeMarker( const visualization_msgs::InteractiveMarker &int_marker, std::vector<uint8_t> &buffer )
+{
+  uint32_t length = ros::serialization::serializationLength( int_marker );
+  buffer.resize( length );
+  if ( length > 0 )
+  {
+    ros::serialization::OStream stream( &buffer[0], length );
+    ros::serialization::serialize( stream, int_marker );
+  }
+}
+
+// Hash over the serialized marker, so that every field counts. Never 0.
+size_t fingerprint( const std::vector<uint8_t> &buffer )
+{
+  size_t hash = boost::hash_range( buffer.begin(), buffer.end() );
+  return hash != 0 ? hash : 1;
+}
+
+bool posesEqual( const geometry_msgs::Pose &a, const geometry_msgs::Pose &b, double epsilon )
+{
+  return fabs( a.position.x - b.position.x ) <= epsilon &&
+      fabs( a.position.y - b.position.y ) <= epsilon &&
+      fabs( a.position.z - b.position.z ) <= epsilon &&
+      fabs( a.orientation.x - b.orientation.x ) <= epsilon &&
+      fabs( a.orientation.y - b.orientation.y ) <= epsilon &&
+      fabs( a.orientation.z - b.orientation.z ) <= epsilon &&
+      fabs( a.orientation.w - b.orientation.w ) <= epsilon;
+}
+
+bool headersEqual( const std_msgs::Header &a, const std_msgs::Header &b )
+{
+  return a.frame_id == b.frame_id && a.stamp == b.stamp;
+}
+
+}
+
+InteractiveMarkerServer::InteractiveMarkerServer( const std::string &topic_ns, const std::string &server_id, bool spin_thread,
+    unsigned num_shards ) :
+    num_shards_( std::max( num_shards, 1u ) ),
+    shards_( new MarkerShard[num_shards_] ),
     topic_ns_(topic_ns),
-    seq_num_(0)
+    max_message_size_(0),
+    stop_publish_thread_(false),
+    separate_poses_(false),
+    compact_pose_resolution_(0.0),
+    shared_prototypes_(false),
+    executor_(0),
+    dispatching_feedback_(false),
+    seq_num_(0),
+    published_seq_num_(0)
 {
   if ( spin_thread )
   {
@@ -50,6 +116,46 @@ InteractiveMarkerServer::InteractiveMarkerServer( const std::string &topic_ns, c
     node_handle_.setCallbackQueue( &callback_queue_ );
   }
 
+  init( topic_ns, server_id );
+
+  keep_alive_timer_ =  node_handle_.createTimer(ros::Duration(KEEP_ALIVE_PERIOD), boost::bind( &InteractiveMarkerServer::keepAlive, this ) );
+
+  if ( spin_thread )
+  {
+    spin_thread_.reset( new boost::thread(boost::bind(&InteractiveMarkerServer::spinThread, this)) );
+  }
+
+  publishInit( seq_num_, std::vector<visualization_msgs::InteractiveMarkerConstPtr>() );
+}
+
+
+InteractiveMarkerServer::InteractiveMarkerServer( const std::string &topic_ns, const std::string &server_id,
+    InteractiveMarkerExecutor &executor, unsigned num_shards ) :
+    num_shards_( std::max( num_shards, 1u ) ),
+    shards_( new MarkerShard[num_shards_] ),
+    topic_ns_(topic_ns),
+    max_message_size_(0),
+    stop_publish_thread_(false),
+    separate_poses_(false),
+    compact_pose_resolution_(0.0),
+    shared_prototypes_(false),
+    executor_(&executor),
+    dispatching_feedback_(false),
+    seq_num_(0),
+    published_seq_num_(0)
+{
+  node_handle_.setCallbackQueue( executor.getCallbackQueue() );
+
+  init( topic_ns, server_id );
+
+  executor.addKeepAlive( this, boost::bind( &InteractiveMarkerServer::keepAlive, this ) );
+
+  publishInit( seq_num_, std::vector<visualization_msgs::InteractiveMarkerConstPtr>() );
+}
+
+
+void InteractiveMarkerServer::init( const std::string &topic_ns, const std::string &server_id )
+{
   if (!server_id.empty())
   {
     server_id_ = ros::this_node::getName() + "/" + server_id;
@@ -66,16 +172,15 @@ InteractiveMarkerServer::InteractiveMarkerServer( const std::string &topic_ns, c
   init_pub_ = node_handle_.advertise<visualization_msgs::InteractiveMarkerInit>( init_topic, 100, true );
   update_pub_ = node_handle_.advertise<visualization_msgs::InteractiveMarkerUpdate>( update_topic, 100 );
   feedback_sub_ = node_handle_.subscribe( feedback_topic, 100, &InteractiveMarkerServer::processFeedback, this );
+}
 
-  keep_alive_timer_ =  node_handle_.createTimer(ros::Duration(0.5f), boost::bind( &InteractiveMarkerServer::keepAlive, this ) );
-
-  if ( spin_thread )
-  {
-    need_to_terminate_ = false;
-    spin_thread_.reset( new boost::thread(boost::bind(&InteractiveMarkerServer::spinThread, this)) );
-  }
 
-  publishInit();
+InteractiveMarkerServer::MarkerShard::MarkerShard() :
+    last_replacement_type(DEFAULT_FEEDBACK_CB),
+    skip_unchanged(false),
+    pose_epsilon(0.0),
+    num_skipped_updates(0)
+{
 }
 
 
@@ -83,418 +188,2088 @@ InteractiveMarkerServer::~InteractiveMarkerServer()
 {
   if (spin_thread_.get())
   {
-    need_to_terminate_ = true;
+    callback_queue_.disable();
     spin_thread_->join();
   }
 
+  if ( executor_ )
+  {
+    // the worker threads may still be handling our feedback or keep-alive.
+    // Both calls wait for that to finish.
+    executor_->removeKeepAlive( this );
+    feedback_sub_.shutdown();
+
+    M_FilteredTopic filtered_topics;
+    {
+      boost::mutex::scoped_lock publish_lock( publish_mutex_ );
+      filtered_topics.swap( filtered_topics_ );
+    }
+    M_FilteredTopic::iterator it;
+    for ( it = filtered_topics.begin(); it != filtered_topics.end(); it++ )
+    {
+      it->second->feedback_sub.shutdown();
+    }
+  }
+
   if ( node_handle_.ok() )
   {
     clear();
     applyChanges();
   }
+
+  // nothing is held back anymore, so the timer won't be started again.
+  // Stopping it waits for a running flushHeldUpdates(), which needs apply_mutex_.
+  ros::WallTimer flush_timer;
+  {
+    boost::mutex::scoped_lock apply_lock( apply_mutex_ );
+    flush_timer = flush_timer_;
+  }
+  flush_timer.stop();
+
+  if ( publish_thread_.get() )
+  {
+    {
+      boost::mutex::scoped_lock apply_lock( apply_mutex_ );
+      stop_publish_thread_ = true;
+      publish_queue_cond_.notify_one();
+    }
+    publish_thread_->join();
+  }
 }
 
 
 void InteractiveMarkerServer::spinThread()
 {
-  while (node_handle_.ok())
+  // callAvailable() wakes up as soon as a callback is queued or the queue
+  // gets disabled. The timeout only matters for noticing a ROS shutdown.
+  while ( node_handle_.ok() && callback_queue_.isEnabled() )
   {
-    if (need_to_terminate_)
-    {
-      break;
-    }
-    callback_queue_.callAvailable(ros::WallDuration(0.033f));
+    callback_queue_.callAvailable( ros::WallDuration( 0.1 ) );
   }
 }
 
 
 void InteractiveMarkerServer::applyChanges()
 {
-  boost::recursive_mutex::scoped_lock lock( mutex_ );
+  boost::mutex::scoped_lock apply_lock( apply_mutex_ );
 
-  if ( pending_updates_.empty() )
+  if ( publish_thread_.get() )
   {
+    // earlier updates may still be queued, so this one has to go through the queue as well
+    boost::shared_future<void> published = queueUpdate();
+    apply_lock.unlock();
+    published.wait();
     return;
   }
 
-  M_UpdateContext::iterator update_it;
-
-  visualization_msgs::InteractiveMarkerUpdate update;
-  update.type = visualization_msgs::InteractiveMarkerUpdate::UPDATE;
+  UpdateBatchPtr batch = applyPendingUpdates();
+  if ( !batch )
+  {
+    return;
+  }
 
-  update.markers.reserve( marker_contexts_.size() );
-  update.poses.reserve( marker_contexts_.size() );
-  update.erases.reserve( marker_contexts_.size() );
+  publishUpdate( *batch );
 
-  for ( update_it = pending_updates_.begin(); update_it != pending_updates_.end(); update_it++ )
+  if ( batch->has_update )
   {
-    M_MarkerContext::iterator marker_context_it = marker_contexts_.find( update_it->first );
+    std::vector<visualization_msgs::InteractiveMarkerConstPtr> int_markers;
+    getMarkers( int_markers );
+    publishInit( batch->seq_num, int_markers );
+  }
+}
 
-    switch ( update_it->second.update_type )
-    {
-      case UpdateContext::FULL_UPDATE:
-      {
-        if ( marker_context_it == marker_contexts_.end() )
-        {
-          ROS_DEBUG("Creating new context for %s", update_it->first.c_str());
-          // create a new int_marker context
-          marker_context_it = marker_contexts_.insert( std::make_pair( update_it->first, MarkerContext() ) ).first;
-          // copy feedback cbs, in case they have been set before the marker context was created
-          marker_context_it->second.default_feedback_cb = update_it->second.default_feedback_cb;
-          marker_context_it->second.feedback_cbs = update_it->second.feedback_cbs;
-        }
 
-        marker_context_it->second.int_marker = update_it->second.int_marker;
+boost::shared_future<void> InteractiveMarkerServer::applyChangesAsync()
+{
+  boost::mutex::scoped_lock apply_lock( apply_mutex_ );
 
-        update.markers.push_back( marker_context_it->second.int_marker );
-        break;
-      }
+  if ( !publish_thread_.get() )
+  {
+    publish_thread_.reset( new boost::thread( boost::bind( &InteractiveMarkerServer::publishThread, this ) ) );
+  }
 
-      case UpdateContext::POSE_UPDATE:
-      {
-        if ( marker_context_it == marker_contexts_.end() )
-        {
-          ROS_ERROR( "Pending pose update for non-existing marker found. This is a bug in InteractiveMarkerInterface." );
-        }
-        else
-        {
-          marker_context_it->second.int_marker.pose = update_it->second.int_marker.pose;
-          marker_context_it->second.int_marker.header = update_it->second.int_marker.header;
+  return queueUpdate();
+}
 
-          visualization_msgs::InteractiveMarkerPose pose_update;
-          pose_update.header = marker_context_it->second.int_marker.header;
-          pose_update.pose = marker_context_it->second.int_marker.pose;
-          pose_update.name = marker_context_it->second.int_marker.name;
-          update.poses.push_back( pose_update );
-        }
-        break;
-      }
 
-      case UpdateContext::ERASE:
-      {
-        if ( marker_context_it != marker_contexts_.end() )
-        {
-          marker_contexts_.erase( update_it->first );
-          update.erases.push_back( update_it->first );
-        }
-        break;
-      }
+boost::shared_future<void> InteractiveMarkerServer::queueUpdate( bool held_only )
+{
+  UpdateBatchPtr batch = applyPendingUpdates( held_only );
+  if ( !batch )
+  {
+    if ( !last_published_.valid() )
+    {
+      boost::promise<void> nothing_to_publish;
+      nothing_to_publish.set_value();
+      last_published_ = boost::shared_future<void>( nothing_to_publish.get_future() );
     }
+    return last_published_;
   }
 
-  seq_num_++;
-
-  publish( update );
-  publishInit();
-  pending_updates_.clear();
+  last_published_ = boost::shared_future<void>( batch->published.get_future() );
+  publish_queue_.push_back( batch );
+  publish_queue_cond_.notify_one();
+  return last_published_;
 }
 
 
-bool InteractiveMarkerServer::erase( const std::string &name )
+void InteractiveMarkerServer::publishThread()
 {
-  boost::recursive_mutex::scoped_lock lock( mutex_ );
-
-  pending_updates_[name].update_type = UpdateContext::ERASE;
-  return true;
-}
+  boost::mutex::scoped_lock apply_lock( apply_mutex_ );
 
-void InteractiveMarkerServer::clear()
-{
-  // erase all markers
-  pending_updates_.clear();
-  M_MarkerContext::iterator it;
-  for ( it = marker_contexts_.begin(); it != marker_contexts_.end(); it++ )
+  while ( true )
   {
-    erase( it->first );
-  }
-}
+    while ( publish_queue_.empty() && !stop_publish_thread_ )
+    {
+      publish_queue_cond_.wait( apply_lock );
+    }
 
+    if ( publish_queue_.empty() )
+    {
+      return;
+    }
 
-bool InteractiveMarkerServer::setPose( const std::string &name, const geometry_msgs::Pose &pose, const std_msgs::Header &header )
-{
-  boost::recursive_mutex::scoped_lock lock( mutex_ );
+    UpdateBatchPtr batch = publish_queue_.front();
+    publish_queue_.pop_front();
+    apply_lock.unlock();
 
-  M_MarkerContext::iterator marker_context_it = marker_contexts_.find( name );
-  M_UpdateContext::iterator update_it = pending_updates_.find( name );
+    publishUpdate( *batch );
 
-  // if there's no marker and no pending addition for it, we can't update the pose
-  if ( marker_context_it == marker_contexts_.end() &&
-      ( update_it == pending_updates_.end() || update_it->second.update_type != UpdateContext::FULL_UPDATE ) )
-  {
-    return false;
-  }
+    // only the newest state needs to go out on the init topic
+    apply_lock.lock();
+    bool newer_update_queued = false;
+    for ( size_t i = 0; i < publish_queue_.size(); i++ )
+    {
+      newer_update_queued = newer_update_queued || publish_queue_[i]->has_update;
+    }
+    if ( batch->has_update && !newer_update_queued )
+    {
+      std::vector<visualization_msgs::InteractiveMarkerConstPtr> int_markers;
+      getMarkers( int_markers );
+      apply_lock.unlock();
+      publishInit( batch->seq_num, int_markers );
+      apply_lock.lock();
+    }
 
-  if ( header.frame_id.empty() )
-  {
-    // keep the old header
-    doSetPose( update_it, name, pose, marker_context_it->second.int_marker.header );
+    batch->published.set_value();
   }
-  else
-  {
-    doSetPose( update_it, name, pose, header );
-  }
-  return true;
 }
 
-bool InteractiveMarkerServer::setCallback( const std::string &name, FeedbackCallback feedback_cb, uint8_t feedback_type  )
+
+InteractiveMarkerServer::UpdateBatchPtr InteractiveMarkerServer::applyPendingUpdates( bool held_only )
 {
-  boost::recursive_mutex::scoped_lock lock( mutex_ );
+  UpdateBatchPtr batch = boost::make_shared<UpdateBatch>();
+  batch->filtered = !filtered_topics_.empty();
 
-  M_MarkerContext::iterator marker_context_it = marker_contexts_.find( name );
-  M_UpdateContext::iterator update_it = pending_updates_.find( name );
+  ros::WallTime now = ros::WallTime::now();
 
-  if ( marker_context_it == marker_contexts_.end() && update_it == pending_updates_.end() )
+  // collect the updates shard by shard, so writers to the other shards can go on
+  bool has_updates = false;
+  ros::WallTime next_release;
+  for ( unsigned i = 0; i < num_shards_; i++ )
   {
-    return false;
+    boost::unique_lock<boost::shared_mutex> lock( shards_[i].mutex );
+    if ( applyPendingUpdates( shards_[i], now, held_only, *batch, next_release ) )
+    {
+      has_updates = true;
+    }
   }
 
-  // we need to overwrite both the callbacks for the actual marker
-  // and the update, if there's any
-
-  if ( marker_context_it != marker_contexts_.end() )
+  // applyChanges() may not be called again, so the held updates
+  // have to go out on their own once their interval has passed
+  if ( !next_release.isZero() && ( flush_time_.isZero() || next_release < flush_time_ ) )
   {
-    // the marker exists, so we can just overwrite the existing callbacks
-    if ( feedback_type == DEFAULT_FEEDBACK_CB )
-    {
-      marker_context_it->second.default_feedback_cb = feedback_cb;
-    }
-    else
-    {
-      if ( feedback_cb )
-      {
-        marker_context_it->second.feedback_cbs[feedback_type] = feedback_cb;
-      }
-      else
-      {
-        marker_context_it->second.feedback_cbs.erase( feedback_type );
-      }
-    }
+    flush_time_ = next_release;
+    flush_timer_ = node_handle_.createWallTimer( next_release - now,
+        boost::bind( &InteractiveMarkerServer::flushHeldUpdates, this ), true );
   }
 
-  if ( update_it != pending_updates_.end() )
+  // the group frames go out with the same batch, unless
+  // they have been changed without calling applyChanges()
+  if ( !held_only )
   {
-    if ( feedback_type == DEFAULT_FEEDBACK_CB )
-    {
-      update_it->second.default_feedback_cb = feedback_cb;
-    }
-    else
+    boost::unique_lock<boost::shared_mutex> groups_lock( groups_mutex_ );
+    M_MarkerGroup::iterator it;
+    for ( it = groups_.begin(); it != groups_.end(); it++ )
     {
-      if ( feedback_cb )
-      {
-        update_it->second.feedback_cbs[feedback_type] = feedback_cb;
-      }
-      else
+      if ( it->second.changed )
       {
-        update_it->second.feedback_cbs.erase( feedback_type );
+        batch->group_frames.push_back( it->first );
+        batch->group_poses.push_back( it->second.pose );
+        batch->group_headers.push_back( it->second.header );
+        it->second.changed = false;
       }
     }
   }
-  return true;
-}
 
-void InteractiveMarkerServer::insert( const visualization_msgs::InteractiveMarker &int_marker )
-{
-  boost::recursive_mutex::scoped_lock lock( mutex_ );
+  if ( !has_updates && batch->group_frames.empty() )
+  {
+    return UpdateBatchPtr();
+  }
 
-  M_UpdateContext::iterator update_it = pending_updates_.find( int_marker.name );
-  if ( update_it == pending_updates_.end() )
+  if ( has_updates && max_message_size_ > 0 )
   {
-    update_it = pending_updates_.insert( std::make_pair( int_marker.name, UpdateContext() ) ).first;
+    splitBatch( *batch );
   }
 
-  update_it->second.update_type = UpdateContext::FULL_UPDATE;
-  update_it->second.int_marker = int_marker;
+  // each message of a split batch gets its own sequence number
+  batch->has_update = has_updates;
+  if ( has_updates )
+  {
+    seq_num_ += std::max<size_t>( batch->splits.size(), 1 );
+  }
+  batch->seq_num = seq_num_;
+  return batch;
 }
 
-void InteractiveMarkerServer::insert( const visualization_msgs::InteractiveMarker &int_marker,
-    FeedbackCallback feedback_cb, uint8_t feedback_type)
-{
-  insert( int_marker );
-
-  setCallback( int_marker.name, feedback_cb, feedback_type  );
-}
 
-bool InteractiveMarkerServer::get( std::string name, visualization_msgs::InteractiveMarker &int_marker ) const
+void InteractiveMarkerServer::publishUpdate( UpdateBatch &batch )
 {
-  M_UpdateContext::const_iterator update_it = pending_updates_.find( name );
+  publishGroupTransforms( batch.group_frames, batch.group_poses, batch.group_headers );
 
-  if ( update_it == pending_updates_.end() )
+  if ( !batch.has_update )
   {
-    M_MarkerContext::const_iterator marker_context_it = marker_contexts_.find( name );
-    if ( marker_context_it == marker_contexts_.end() )
-    {
-      return false;
-    }
-
-    int_marker = marker_context_it->second.int_marker;
-    return true;
+    return;
   }
 
-  // if there's an update pending, we'll have to account for that
-  switch ( update_it->second.update_type )
+  // a batch that is not split is one message up to its end
+  std::vector<UpdateBatch::Split> splits( batch.splits );
+  if ( splits.empty() )
   {
-    case UpdateContext::ERASE:
-      return false;
+    UpdateBatch::Split end = { batch.markers.size(), batch.poses.size(), batch.erases.size() };
+    splits.push_back( end );
+  }
 
-    case UpdateContext::POSE_UPDATE:
+  // the messages of a split batch count up to its sequence number
+  uint64_t seq_num = batch.seq_num - ( splits.size() - 1 );
+  UpdateBatch::Split begin = { 0, 0, 0 };
+  bool expand = !sharedPrototypes();
+
+  for ( size_t i = 0; i < splits.size(); i++, seq_num++ )
+  {
+    // publish by pointer, so that subscribers in the same process
+    // receive this message without it being serialized
+    visualization_msgs::InteractiveMarkerUpdatePtr update =
+        boost::make_shared<visualization_msgs::InteractiveMarkerUpdate>();
+    update->type = visualization_msgs::InteractiveMarkerUpdate::UPDATE;
+
+    update->markers.reserve( splits[i].markers_end - begin.markers_end );
+    for ( size_t m = begin.markers_end; m < splits[i].markers_end; m++ )
     {
-      M_MarkerContext::const_iterator marker_context_it = marker_contexts_.find( name );
-      if ( marker_context_it == marker_contexts_.end() )
-      {
-        return false;
-      }
-      int_marker = marker_context_it->second.int_marker;
-      int_marker.pose = update_it->second.int_marker.pose;
-      return true;
+      addMarker( update->markers, *batch.markers[m], expand );
     }
-
-    case UpdateContext::FULL_UPDATE:
-      int_marker = update_it->second.int_marker;
-      return true;
+    update->poses.assign( batch.poses.begin() + begin.poses_end, batch.poses.begin() + splits[i].poses_end );
+    update->erases.assign( batch.erases.begin() + begin.erases_end, batch.erases.begin() + splits[i].erases_end );
+
+    boost::mutex::scoped_lock publish_lock( publish_mutex_ );
+    published_seq_num_ = seq_num;
+    publishUpdateMessage( update );
+    publishFilteredUpdates( batch, begin, splits[i], seq_num );
+    begin = splits[i];
   }
 
-  return false;
+  publishTransforms();
 }
 
-void InteractiveMarkerServer::publishInit()
-{
-  boost::recursive_mutex::scoped_lock lock( mutex_ );
-
-  visualization_msgs::InteractiveMarkerInit init;
-  init.server_id = server_id_;
-  init.seq_num = seq_num_;
-  init.markers.reserve( marker_contexts_.size() );
 
-  M_MarkerContext::iterator it;
-  for ( it = marker_contexts_.begin(); it != marker_contexts_.end(); it++ )
+void InteractiveMarkerServer::publishUpdateMessage( const visualization_msgs::InteractiveMarkerUpdatePtr &update )
+{
+  // poses go out first on their own topic, so that they
+  // do not have to wait for large marker definitions
+  bool compact_poses = compact_pose_resolution_ > 0.0;
+  bool separate_poses = separate_poses_ || compact_poses;
+  visualization_msgs::InteractiveMarkerUpdatePtr pose_update =
+      boost::make_shared<visualization_msgs::InteractiveMarkerUpdate>();
+  if ( separate_poses )
+  {
+    pose_update->poses.swap( update->poses );
+  }
+  if ( !pose_update->poses.empty() )
   {
-    ROS_DEBUG( "Publishing %s", it->second.int_marker.name.c_str() );
-    init.markers.push_back( it->second.int_marker );
+    pose_update->type = visualization_msgs::InteractiveMarkerUpdate::UPDATE;
+    pose_update->server_id = server_id_;
+    pose_update->seq_num = published_seq_num_;
+    if ( compact_poses )
+    {
+      std_msgs::UInt8MultiArrayPtr compact = boost::make_shared<std_msgs::UInt8MultiArray>();
+      encodeCompactPoses( *pose_update, compact_pose_resolution_, compact->data );
+      compact_pose_pub_.publish( compact );
+    }
+    else
+    {
+      pose_update_pub_.publish( pose_update );
+    }
   }
 
-  init_pub_.publish( init );
+  publish( update );
 }
 
-void InteractiveMarkerServer::processFeedback( const FeedbackConstPtr& feedback )
-{
-  boost::recursive_mutex::scoped_lock lock( mutex_ );
 
-  M_MarkerContext::iterator marker_context_it = marker_contexts_.find( feedback->marker_name );
+void InteractiveMarkerServer::splitBatch( UpdateBatch &batch ) const
+{
+  visualization_msgs::InteractiveMarkerUpdate empty_update;
+  empty_update.server_id = server_id_;
+  const uint32_t empty_size = ros::serialization::serializationLength( empty_update );
 
-  // ignore feedback for non-existing markers
-  if ( marker_context_it == marker_contexts_.end() )
+  // serialized size of each change, in the order they are put into messages
+  std::vector<uint32_t> sizes;
+  sizes.reserve( batch.markers.size() + batch.poses.size() + batch.erases.size() );
+  for ( size_t i = 0; i < batch.markers.size(); i++ )
   {
-    return;
+    sizes.push_back( ros::serialization::serializationLength( *batch.markers[i] ) );
   }
-
-  MarkerContext &marker_context = marker_context_it->second;
-
-  // if two callers try to modify the same marker, reject (timeout= 1 sec)
-  if ( marker_context.last_client_id != feedback->client_id &&
-      (ros::Time::now() - marker_context.last_feedback).toSec() < 1.0 )
+  for ( size_t i = 0; i < batch.poses.size(); i++ )
   {
-    ROS_DEBUG( "Rejecting feedback for %s: conflicting feedback from separate clients.", feedback->marker_name.c_str() );
-    return;
+    sizes.push_back( ros::serialization::serializationLength( batch.poses[i] ) );
+  }
+  for ( size_t i = 0; i < batch.erases.size(); i++ )
+  {
+    sizes.push_back( 4 + batch.erases[i].size() );
   }
 
-  marker_context.last_feedback = ros::Time::now();
-  marker_context.last_client_id = feedback->client_id;
-
-  if ( feedback->event_type == visualization_msgs::InteractiveMarkerFeedback::POSE_UPDATE )
+  // fill each message as far as possible, but put at least one change into it
+  uint32_t size = empty_size;
+  for ( size_t i = 0; i < sizes.size(); i++ )
   {
-    if ( marker_context.int_marker.header.stamp == ros::Time(0) )
-    {
-      // keep the old header
-      doSetPose( pending_updates_.find( feedback->marker_name ), feedback->marker_name, feedback->pose, marker_context.int_marker.header );
-    }
-    else
+    if ( size > empty_size && size + sizes[i] > max_message_size_ )
     {
-      doSetPose( pending_updates_.find( feedback->marker_name ), feedback->marker_name, feedback->pose, feedback->header );
+      batch.splits.push_back( splitAt( batch, i ) );
+      size = empty_size;
     }
+    size += sizes[i];
   }
 
-  // call feedback handler
-  boost::unordered_map<uint8_t,FeedbackCallback>::iterator feedback_cb_it = marker_context.feedback_cbs.find( feedback->event_type );
-  if ( feedback_cb_it != marker_context.feedback_cbs.end() && feedback_cb_it->second )
-  {
-    // call type-specific callback
-    feedback_cb_it->second( feedback );
-  }
-  else if ( marker_context.default_feedback_cb )
+  if ( !batch.splits.empty() )
   {
-    // call default callback
-    marker_context.default_feedback_cb(  feedback );
+    batch.splits.push_back( splitAt( batch, sizes.size() ) );
   }
 }
 
 
-void InteractiveMarkerServer::keepAlive()
+InteractiveMarkerServer::UpdateBatch::Split InteractiveMarkerServer::splitAt( const UpdateBatch &batch, size_t index )
 {
-  visualization_msgs::InteractiveMarkerUpdate empty_update;
-  empty_update.type = visualization_msgs::InteractiveMarkerUpdate::KEEP_ALIVE;
-  publish( empty_update );
+  UpdateBatch::Split split;
+  split.markers_end = std::min( index, batch.markers.size() );
+  index -= split.markers_end;
+  split.poses_end = std::min( index, batch.poses.size() );
+  index -= split.poses_end;
+  split.erases_end = index;
+  return split;
 }
 
 
-void InteractiveMarkerServer::publish( visualization_msgs::InteractiveMarkerUpdate &update )
+void InteractiveMarkerServer::setMaxMessageSize( uint32_t max_size )
 {
-  update.server_id = server_id_;
-  update.seq_num = seq_num_;
-  update_pub_.publish( update );
-  //
-  // publish tf update_it->second.int_marker.pose -> feedback->marker_name;
-  for(M_MarkerContext::iterator it = marker_contexts_.begin(); it != marker_contexts_.end(); it++) {
-    ROS_DEBUG( "Markers '%s' publish tf from ~%s to %s",
-	       it->first.c_str(),
-	       it->second.int_marker.header.frame_id.c_str(),
-	       it->second.int_marker.name.c_str() );
-    static tf::TransformBroadcaster br;
-    tf::Transform transform;
-    geometry_msgs::Pose pose;
-    pose = it->second.int_marker.pose;
-
-    transform.setOrigin( tf::Vector3( pose.position.x,
-				      pose.position.y,
-				      pose.position.z ));
-    
-    if( (pose.orientation.x =! pose.orientation.x) ||
-	(pose.orientation.y =! pose.orientation.y) ||
-	(pose.orientation.z =! pose.orientation.z) ||
-	(pose.orientation.w =! pose.orientation.w) ){
-      transform.setRotation( tf::Quaternion( 0,
-					     0,
-					     0,
-					     1 ));
-    }else{
-      transform.setRotation( tf::Quaternion( pose.orientation.x,
-					     pose.orientation.y,
-					     pose.orientation.z,
-					     pose.orientation.w ));
-    }
-    
-    br.sendTransform( tf::StampedTransform( transform,
-					    ros::Time::now(),
-					    it->second.int_marker.header.frame_id,
-					    it->second.int_marker.name ));
-  }
+  boost::mutex::scoped_lock apply_lock( apply_mutex_ );
+  max_message_size_ = max_size;
 }
 
 
-void InteractiveMarkerServer::doSetPose( M_UpdateContext::iterator update_it, const std::string &name, const geometry_msgs::Pose &pose, const std_msgs::Header &header )
+void InteractiveMarkerServer::publishFilteredUpdates( const UpdateBatch &batch, const UpdateBatch::Split &begin,
+    const UpdateBatch::Split &end, uint64_t seq_num )
 {
-  if ( update_it == pending_updates_.end() )
-  {
-    update_it = pending_updates_.insert( std::make_pair( name, UpdateContext() ) ).first;
-    update_it->second.update_type = UpdateContext::POSE_UPDATE;
-  }
-  else if ( update_it->second.update_type != UpdateContext::FULL_UPDATE )
+  M_FilteredTopic::iterator topic_it;
+  for ( topic_it = filtered_topics_.begin(); topic_it != filtered_topics_.end(); topic_it++ )
   {
-    update_it->second.update_type = UpdateContext::POSE_UPDATE;
-  }
+    FilteredTopic &topic = *topic_it->second;
 
-  update_it->second.int_marker.pose = pose;
-  update_it->second.int_marker.header = header;
-  ROS_DEBUG( "Marker '%s' is now at %f, %f, %f", update_it->first.c_str(), pose.position.x, pose.position.y, pose.position.z );
+    // the init message of the topic has these changes already.
+    // Batches without the state for the filters are always among them.
+    if ( seq_num <= topic.first_seq_num || !batch.filtered )
+    {
+      continue;
+    }
+
+    visualization_msgs::InteractiveMarkerUpdatePtr filtered_update =
+        boost::make_shared<visualization_msgs::InteractiveMarkerUpdate>();
+    filtered_update->type = visualization_msgs::InteractiveMarkerUpdate::UPDATE;
+
+    for ( size_t i = begin.markers_end; i < end.markers_end; i++ )
+    {
+      const visualization_msgs::InteractiveMarker &int_marker = *batch.markers[i];
+      if ( matches( topic.filter, int_marker.name, int_marker.header, int_marker.pose ) )
+      {
+        addFilteredMarker( filtered_update->markers, int_marker, batch.marker_levels_of_detail[i], topic.filter );
+        topic.visible.insert( int_marker.name );
+      }
+      else if ( topic.visible.erase( int_marker.name ) )
+      {
+        filtered_update->erases.push_back( int_marker.name );
+      }
+    }
+
+    for ( size_t i = begin.poses_end; i < end.poses_end; i++ )
+    {
+      const visualization_msgs::InteractiveMarkerPose &pose = batch.poses[i];
+      if ( !matches( topic.filter, pose.name, pose.header, pose.pose ) )
+      {
+        if ( topic.visible.erase( pose.name ) )
+        {
+          filtered_update->erases.push_back( pose.name );
+        }
+      }
+      else if ( topic.visible.count( pose.name ) )
+      {
+        filtered_update->poses.push_back( pose );
+      }
+      else
+      {
+        // the marker has just moved into the region,
+        // so its clients need all of it
+        addFilteredMarker( filtered_update->markers, *batch.pose_markers[i],
+            batch.pose_levels_of_detail[i], topic.filter );
+        topic.visible.insert( pose.name );
+      }
+    }
+
+    for ( size_t i = begin.erases_end; i < end.erases_end; i++ )
+    {
+      if ( topic.visible.erase( batch.erases[i] ) )
+      {
+        filtered_update->erases.push_back( batch.erases[i] );
+      }
+    }
+
+    if ( filtered_update->markers.empty() && filtered_update->poses.empty() &&
+         filtered_update->erases.empty() )
+    {
+      continue;
+    }
+
+    filtered_update->server_id = server_id_;
+    filtered_update->seq_num = ++topic.seq_num;
+    topic.update_pub.publish( filtered_update );
+    topic.last_publish_time = ros::Time::now();
+  }
+}
+
+
+bool InteractiveMarkerServer::matches( const InterestFilter &filter,
+    const std::string &name,
+    const std_msgs::Header &header,
+    const geometry_msgs::Pose &pose )
+{
+  if ( name.compare( 0, filter.name_prefix.size(), filter.name_prefix ) != 0 )
+  {
+    return false;
+  }
+
+  if ( !filter.group_frame.empty() && header.frame_id != filter.group_frame )
+  {
+    return false;
+  }
+
+  if ( !filter.region_frame.empty() )
+  {
+    const geometry_msgs::Point &p = pose.position;
+    return header.frame_id == filter.region_frame &&
+        p.x >= filter.region_min.x && p.x <= filter.region_max.x &&
+        p.y >= filter.region_min.y && p.y <= filter.region_max.y &&
+        p.z >= filter.region_min.z && p.z <= filter.region_max.z;
+  }
+
+  return true;
+}
+
+
+bool InteractiveMarkerServer::addFilteredTopic( const std::string &topic_ns, const InterestFilter &filter )
+{
+  // no changes may be applied until the topic has its initial state
+  boost::mutex::scoped_lock apply_lock( apply_mutex_ );
+
+  std::vector<visualization_msgs::InteractiveMarkerConstPtr> int_markers;
+  getMarkers( int_markers );
+
+  boost::mutex::scoped_lock publish_lock( publish_mutex_ );
+
+  if ( filtered_topics_.count( topic_ns ) )
+  {
+    return false;
+  }
+
+  FilteredTopicPtr topic = boost::make_shared<FilteredTopic>();
+  topic->filter = filter;
+  topic->seq_num = 0;
+  topic->first_seq_num = seq_num_;
+  topic->init_pub = node_handle_.advertise<visualization_msgs::InteractiveMarkerInit>( topic_ns + "/update_full", 100, true );
+  topic->update_pub = node_handle_.advertise<visualization_msgs::InteractiveMarkerUpdate>( topic_ns + "/update", 100 );
+  topic->feedback_sub = node_handle_.subscribe( topic_ns + "/feedback", 100, &InteractiveMarkerServer::processFeedback, this );
+  filtered_topics_[topic_ns] = topic;
+
+  publishFilteredInit( *topic, int_markers );
+  return true;
+}
+
+
+bool InteractiveMarkerServer::removeFilteredTopic( const std::string &topic_ns )
+{
+  FilteredTopicPtr topic;
+  {
+    boost::mutex::scoped_lock apply_lock( apply_mutex_ );
+    boost::mutex::scoped_lock publish_lock( publish_mutex_ );
+    M_FilteredTopic::iterator it = filtered_topics_.find( topic_ns );
+    if ( it == filtered_topics_.end() )
+    {
+      return false;
+    }
+    topic = it->second;
+    filtered_topics_.erase( it );
+  }
+
+  // waits for running feedback callbacks, which must not hold publish_mutex_
+  topic->feedback_sub.shutdown();
+  return true;
+}
+
+
+bool InteractiveMarkerServer::applyPendingUpdates( MarkerShard &shard, const ros::WallTime &now, bool held_only,
+    UpdateBatch &batch, ros::WallTime &next_release )
+{
+  if ( shard.pending_updates.empty() )
+  {
+    return false;
+  }
+
+  // updates that stay pending, e.g. for the maximum publish rate
+  M_UpdateContext remaining_updates;
+
+  M_UpdateContext::iterator update_it;
+
+  for ( update_it = shard.pending_updates.begin(); update_it != shard.pending_updates.end(); update_it++ )
+  {
+    if ( held_only && !update_it->second.held )
+    {
+      // not applied yet
+      remaining_updates.insert( *update_it );
+      continue;
+    }
+
+    M_MarkerContext::iterator marker_context_it = shard.marker_contexts.find( update_it->first );
+
+    switch ( update_it->second.update_type )
+    {
+      case UpdateContext::FULL_UPDATE:
+      {
+        if ( marker_context_it == shard.marker_contexts.end() )
+        {
+          ROS_DEBUG("Creating new context for %s", update_it->first.c_str());
+          // create a new int_marker context
+          marker_context_it = shard.marker_contexts.insert( std::make_pair( update_it->first, MarkerContext() ) ).first;
+          // share feedback cbs, in case they have been set before the marker context was created
+          marker_context_it->second.feedback_cbs = update_it->second.feedback_cbs;
+        }
+
+        // take over the new marker without copying it
+        marker_context_it->second.int_marker.swap( update_it->second.int_marker );
+        marker_context_it->second.fingerprint = update_it->second.fingerprint;
+        marker_context_it->second.levels_of_detail.swap( update_it->second.levels_of_detail );
+        marker_context_it->second.last_publish_time = now;
+
+        batch.markers.push_back( marker_context_it->second.int_marker );
+        if ( batch.filtered )
+        {
+          batch.marker_levels_of_detail.push_back( marker_context_it->second.levels_of_detail );
+        }
+        break;
+      }
+
+      case UpdateContext::POSE_UPDATE:
+      {
+        if ( marker_context_it == shard.marker_contexts.end() )
+        {
+          ROS_ERROR( "Pending pose update for non-existing marker found. This is a bug in InteractiveMarkerInterface." );
+        }
+        else if ( !min_publish_intervals_.empty() &&
+                  now - marker_context_it->second.last_publish_time < getMinPublishInterval( update_it->first ) )
+        {
+          // too early, later poses will overwrite this one until it goes out
+          UpdateContext &held_update = remaining_updates.insert( *update_it ).first->second;
+          held_update.held = true;
+
+          ros::WallTime release = marker_context_it->second.last_publish_time + getMinPublishInterval( update_it->first );
+          if ( next_release.isZero() || release < next_release )
+          {
+            next_release = release;
+          }
+        }
+        else
+        {
+          visualization_msgs::InteractiveMarker &int_marker = mutableMarker( marker_context_it->second.int_marker );
+          int_marker.pose = update_it->second.pose;
+          int_marker.header = update_it->second.header;
+          marker_context_it->second.fingerprint = 0;
+          marker_context_it->second.last_publish_time = now;
+
+          visualization_msgs::InteractiveMarkerPose pose_update;
+          pose_update.header = int_marker.header;
+          pose_update.pose = int_marker.pose;
+          pose_update.name = int_marker.name;
+          batch.poses.push_back( pose_update );
+          if ( batch.filtered )
+          {
+            batch.pose_markers.push_back( marker_context_it->second.int_marker );
+            batch.pose_levels_of_detail.push_back( marker_context_it->second.levels_of_detail );
+          }
+        }
+        break;
+      }
+
+      case UpdateContext::MENU_UPDATE:
+      {
+        if ( marker_context_it == shard.marker_contexts.end() )
+        {
+          ROS_ERROR( "Pending menu update for non-existing marker found. This is a bug in InteractiveMarkerInterface." );
+        }
+        else
+        {
+          visualization_msgs::InteractiveMarker &int_marker = mutableMarker( marker_context_it->second.int_marker );
+          int_marker.menu_entries.swap( update_it->second.menu_entries );
+          int_marker.pose = update_it->second.pose;
+          int_marker.header = update_it->second.header;
+          marker_context_it->second.fingerprint = 0;
+          marker_context_it->second.last_publish_time = now;
+
+          // clients only understand full updates when the menu changes
+          batch.markers.push_back( marker_context_it->second.int_marker );
+          if ( batch.filtered )
+          {
+            batch.marker_levels_of_detail.push_back( marker_context_it->second.levels_of_detail );
+          }
+        }
+        break;
+      }
+
+      case UpdateContext::ERASE:
+      {
+        if ( marker_context_it != shard.marker_contexts.end() )
+        {
+          shard.marker_contexts.erase( update_it->first );
+          batch.erases.push_back( update_it->first );
+        }
+        break;
+      }
+    }
+  }
+
+  bool has_updates = remaining_updates.size() < shard.pending_updates.size();
+  shard.pending_updates.swap( remaining_updates );
+  return has_updates;
+}
+
+
+void InteractiveMarkerServer::flushHeldUpdates()
+{
+  boost::mutex::scoped_lock apply_lock( apply_mutex_ );
+  flush_time_ = ros::WallTime();
+
+  if ( publish_thread_.get() )
+  {
+    queueUpdate( true );
+    return;
+  }
+
+  UpdateBatchPtr batch = applyPendingUpdates( true );
+  if ( !batch )
+  {
+    return;
+  }
+
+  publishUpdate( *batch );
+
+  if ( batch->has_update )
+  {
+    std::vector<visualization_msgs::InteractiveMarkerConstPtr> int_markers;
+    getMarkers( int_markers );
+    publishInit( batch->seq_num, int_markers );
+  }
+}
+
+
+ros::WallDuration InteractiveMarkerServer::getMinPublishInterval( const std::string &name ) const
+{
+  // the longest matching prefix wins. It sorts last among the matches.
+  ros::WallDuration min_interval;
+  std::map<std::string, ros::WallDuration>::const_iterator it;
+  for ( it = min_publish_intervals_.begin(); it != min_publish_intervals_.end(); it++ )
+  {
+    if ( name.compare( 0, it->first.size(), it->first ) == 0 )
+    {
+      min_interval = it->second;
+    }
+  }
+  return min_interval;
+}
+
+
+void InteractiveMarkerServer::setMaxPublishRate( const std::string &name_prefix, double max_rate )
+{
+  boost::mutex::scoped_lock apply_lock( apply_mutex_ );
+
+  if ( max_rate > 0.0 )
+  {
+    min_publish_intervals_[name_prefix] = ros::WallDuration( 1.0 / max_rate );
+  }
+  else
+  {
+    min_publish_intervals_.erase( name_prefix );
+  }
+}
+
+
+bool InteractiveMarkerServer::erase( const std::string &name )
+{
+  MarkerShard &shard = shardFor( name );
+  boost::unique_lock<boost::shared_mutex> lock( shard.mutex );
+
+  UpdateContext &update = shard.pending_updates[name];
+  update.update_type = UpdateContext::ERASE;
+  update.held = false;
+  update.int_marker.reset();
+
+  if ( shard.spatial_index )
+  {
+    shard.spatial_index->erase( name );
+  }
+  return true;
+}
+
+void InteractiveMarkerServer::clear()
+{
+  // erase all markers
+  for ( unsigned i = 0; i < num_shards_; i++ )
+  {
+    MarkerShard &shard = shards_[i];
+    boost::unique_lock<boost::shared_mutex> lock( shard.mutex );
+
+    shard.pending_updates.clear();
+    M_MarkerContext::iterator it;
+    for ( it = shard.marker_contexts.begin(); it != shard.marker_contexts.end(); it++ )
+    {
+      shard.pending_updates[it->first].update_type = UpdateContext::ERASE;
+    }
+
+    if ( shard.spatial_index )
+    {
+      shard.spatial_index->clear();
+    }
+  }
+}
+
+
+bool InteractiveMarkerServer::setPose( const std::string &name, const geometry_msgs::Pose &pose, const std_msgs::Header &header )
+{
+  MarkerShard &shard = shardFor( name );
+  boost::unique_lock<boost::shared_mutex> lock( shard.mutex );
+
+  M_MarkerContext::iterator marker_context_it = shard.marker_contexts.find( name );
+  M_UpdateContext::iterator update_it = shard.pending_updates.find( name );
+
+  // if there's no marker and no pending addition for it, we can't update the pose
+  if ( marker_context_it == shard.marker_contexts.end() &&
+      ( update_it == shard.pending_updates.end() || update_it->second.update_type != UpdateContext::FULL_UPDATE ) )
+  {
+    return false;
+  }
+
+  const std_msgs::Header *new_header = &header;
+  if ( header.frame_id.empty() )
+  {
+    // keep the old header
+    if ( update_it != shard.pending_updates.end() && update_it->second.update_type == UpdateContext::FULL_UPDATE )
+    {
+      new_header = &update_it->second.int_marker->header;
+    }
+    else
+    {
+      new_header = &marker_context_it->second.int_marker->header;
+    }
+  }
+
+  const UpdateContext* current_update;
+  const visualization_msgs::InteractiveMarker* current_marker;
+  if ( shard.skip_unchanged && find( shard, name, current_update, current_marker ) &&
+       posesEqual( current_update ? current_update->pose : current_marker->pose, pose, shard.pose_epsilon ) &&
+       headersEqual( current_update ? current_update->header : current_marker->header, *new_header ) )
+  {
+    shard.num_skipped_updates++;
+    return true;
+  }
+
+  doSetPose( shard, update_it, name, pose, *new_header );
+  return true;
+}
+
+bool InteractiveMarkerServer::setMenuEntries( const std::string &name,
+    const std::vector<visualization_msgs::MenuEntry> &menu_entries )
+{
+  MarkerShard &shard = shardFor( name );
+  boost::unique_lock<boost::shared_mutex> lock( shard.mutex );
+
+  M_UpdateContext::iterator update_it = shard.pending_updates.find( name );
+  return doSetMenuEntries( shard, shard.marker_contexts.find( name ), update_it, name, menu_entries );
+}
+
+bool InteractiveMarkerServer::setMenuEntries( const std::vector<std::string> &names,
+    const std::vector<visualization_msgs::MenuEntry> &menu_entries,
+    FeedbackCallback feedback_cb,
+    std::vector<std::string> &missing_names )
+{
+  // all markers share one copy of the callback
+  FeedbackCallbackPtr shared_feedback_cb;
+  if ( feedback_cb )
+  {
+    shared_feedback_cb = boost::make_shared<FeedbackCallback>( feedback_cb );
+  }
+
+  // sort the names by shard, so that each shard is locked only once
+  std::vector< std::vector<const std::string*> > shard_names( num_shards_ );
+  for ( size_t i = 0; i < names.size(); i++ )
+  {
+    shard_names[ &shardFor( names[i] ) - shards_.get() ].push_back( &names[i] );
+  }
+
+  for ( unsigned s = 0; s < num_shards_; s++ )
+  {
+    if ( shard_names[s].empty() )
+    {
+      continue;
+    }
+
+    MarkerShard &shard = shards_[s];
+    boost::unique_lock<boost::shared_mutex> lock( shard.mutex );
+
+    for ( size_t i = 0; i < shard_names[s].size(); i++ )
+    {
+      const std::string &name = *shard_names[s][i];
+
+      M_MarkerContext::iterator marker_context_it = shard.marker_contexts.find( name );
+      M_UpdateContext::iterator update_it = shard.pending_updates.find( name );
+
+      if ( !doSetMenuEntries( shard, marker_context_it, update_it, name, menu_entries ) )
+      {
+        missing_names.push_back( name );
+        continue;
+      }
+
+      doSetCallback( shard, marker_context_it, update_it, shared_feedback_cb, visualization_msgs::InteractiveMarkerFeedback::MENU_SELECT );
+    }
+  }
+
+  return missing_names.empty();
+}
+
+bool InteractiveMarkerServer::setCallback( const std::string &name, FeedbackCallback feedback_cb, uint8_t feedback_type  )
+{
+  MarkerShard &shard = shardFor( name );
+  boost::unique_lock<boost::shared_mutex> lock( shard.mutex );
+
+  M_MarkerContext::iterator marker_context_it = shard.marker_contexts.find( name );
+  M_UpdateContext::iterator update_it = shard.pending_updates.find( name );
+
+  if ( marker_context_it == shard.marker_contexts.end() && update_it == shard.pending_updates.end() )
+  {
+    return false;
+  }
+
+  FeedbackCallbackPtr shared_feedback_cb;
+  if ( feedback_cb )
+  {
+    shared_feedback_cb = boost::make_shared<FeedbackCallback>( feedback_cb );
+  }
+
+  return doSetCallback( shard, marker_context_it, update_it, shared_feedback_cb, feedback_type );
+}
+
+void InteractiveMarkerServer::insert( const visualization_msgs::InteractiveMarker &int_marker )
+{
+  MarkerShard &shard = shardFor( int_marker.name );
+
+  // compare with the marker as it will be after applying the pending update.
+  // Holding a reference keeps it from being modified in place meanwhile.
+  bool skip_unchanged = false;
+  size_t current_fingerprint = 0;
+  visualization_msgs::InteractiveMarkerPtr current_marker;
+  {
+    boost::shared_lock<boost::shared_mutex> lock( shard.mutex );
+    skip_unchanged = shard.skip_unchanged;
+    if ( skip_unchanged )
+    {
+      current_marker = getFingerprinted( shard, int_marker.name, current_fingerprint );
+    }
+  }
+
+  // serialize without blocking the shard. Equal hashes are confirmed
+  // byte by byte, so that a collision can't drop a real update.
+  size_t new_fingerprint = 0;
+  bool unchanged = false;
+  if ( skip_unchanged )
+  {
+    std::vector<uint8_t> buffer;
+    serializeMarker( int_marker, buffer );
+    new_fingerprint = fingerprint( buffer );
+
+    if ( current_marker && new_fingerprint == current_fingerprint )
+    {
+      std::vector<uint8_t> current_buffer;
+      serializeMarker( *current_marker, current_buffer );
+      unchanged = ( buffer == current_buffer );
+    }
+  }
+
+  // decimating large meshes takes a while, so don't block the shard
+  // meanwhile, and don't bother for markers that are skipped anyway
+  LevelsOfDetailConstPtr levels_of_detail;
+  if ( !unchanged )
+  {
+    levels_of_detail = makeLevelsOfDetail( int_marker );
+  }
+
+  boost::unique_lock<boost::shared_mutex> lock( shard.mutex );
+
+  if ( unchanged )
+  {
+    // unless the marker has been replaced in the meantime
+    if ( getFingerprinted( shard, int_marker.name, current_fingerprint ) == current_marker )
+    {
+      shard.num_skipped_updates++;
+      return;
+    }
+    lock.unlock();
+    levels_of_detail = makeLevelsOfDetail( int_marker );
+    lock.lock();
+  }
+
+  M_UpdateContext::iterator update_it = shard.pending_updates.find( int_marker.name );
+
+  if ( update_it == shard.pending_updates.end() )
+  {
+    update_it = shard.pending_updates.insert( std::make_pair( int_marker.name, UpdateContext() ) ).first;
+  }
+
+  update_it->second.update_type = UpdateContext::FULL_UPDATE;
+  update_it->second.held = false;
+  update_it->second.int_marker = boost::make_shared<visualization_msgs::InteractiveMarker>( int_marker );
+  update_it->second.fingerprint = new_fingerprint;
+  update_it->second.levels_of_detail = levels_of_detail;
+
+  if ( shard.spatial_index )
+  {
+    shard.spatial_index->insert( int_marker.name, int_marker.header.frame_id, int_marker.pose.position );
+  }
+}
+
+void InteractiveMarkerServer::insert( const visualization_msgs::InteractiveMarker &int_marker,
+    FeedbackCallback feedback_cb, uint8_t feedback_type)
+{
+  insert( int_marker );
+
+  setCallback( int_marker.name, feedback_cb, feedback_type  );
+}
+
+bool InteractiveMarkerServer::get( std::string name, visualization_msgs::InteractiveMarker &int_marker ) const
+{
+  const MarkerShard &shard = shardFor( name );
+  boost::shared_lock<boost::shared_mutex> lock( shard.mutex );
+
+  M_UpdateContext::const_iterator update_it = shard.pending_updates.find( name );
+
+  if ( update_it == shard.pending_updates.end() )
+  {
+    M_MarkerContext::const_iterator marker_context_it = shard.marker_contexts.find( name );
+    if ( marker_context_it == shard.marker_contexts.end() )
+    {
+      return false;
+    }
+
+    int_marker = *marker_context_it->second.int_marker;
+    return true;
+  }
+
+  // if there's an update pending, we'll have to account for that
+  switch ( update_it->second.update_type )
+  {
+    case UpdateContext::ERASE:
+      return false;
+
+    case UpdateContext::POSE_UPDATE:
+    case UpdateContext::MENU_UPDATE:
+    {
+      M_MarkerContext::const_iterator marker_context_it = shard.marker_contexts.find( name );
+      if ( marker_context_it == shard.marker_contexts.end() )
+      {
+        return false;
+      }
+      int_marker = *marker_context_it->second.int_marker;
+      mergeUpdate( update_it->second, int_marker );
+      return true;
+    }
+
+    case UpdateContext::FULL_UPDATE:
+      int_marker = *update_it->second.int_marker;
+      return true;
+  }
+
+  return false;
+}
+
+visualization_msgs::InteractiveMarkerConstPtr InteractiveMarkerServer::get( const std::string &name ) const
+{
+  const MarkerShard &shard = shardFor( name );
+  boost::shared_lock<boost::shared_mutex> lock( shard.mutex );
+  return getHandle( shard, name );
+}
+
+bool InteractiveMarkerServer::getPose( const std::string &name, geometry_msgs::Pose &pose ) const
+{
+  const MarkerShard &shard = shardFor( name );
+  boost::shared_lock<boost::shared_mutex> lock( shard.mutex );
+
+  const UpdateContext* update;
+  const visualization_msgs::InteractiveMarker* int_marker;
+  if ( !find( shard, name, update, int_marker ) )
+  {
+    return false;
+  }
+
+  pose = update ? update->pose : int_marker->pose;
+  return true;
+}
+
+bool InteractiveMarkerServer::getHeader( const std::string &name, std_msgs::Header &header ) const
+{
+  const MarkerShard &shard = shardFor( name );
+  boost::shared_lock<boost::shared_mutex> lock( shard.mutex );
+
+  const UpdateContext* update;
+  const visualization_msgs::InteractiveMarker* int_marker;
+  if ( !find( shard, name, update, int_marker ) )
+  {
+    return false;
+  }
+
+  header = update ? update->header : int_marker->header;
+  return true;
+}
+
+void InteractiveMarkerServer::setGroupPose( const std::string &group_frame,
+    const geometry_msgs::Pose &pose, const std_msgs::Header &header )
+{
+  boost::unique_lock<boost::shared_mutex> groups_lock( groups_mutex_ );
+
+  MarkerGroup &group = groups_[group_frame];
+  group.pose = pose;
+  group.header = header;
+  group.changed = true;
+}
+
+bool InteractiveMarkerServer::eraseGroup( const std::string &group_frame )
+{
+  boost::unique_lock<boost::shared_mutex> groups_lock( groups_mutex_ );
+  return groups_.erase( group_frame ) > 0;
+}
+
+bool InteractiveMarkerServer::getAbsolutePose( const std::string &name,
+    geometry_msgs::Pose &pose, std_msgs::Header &header ) const
+{
+  {
+    const MarkerShard &shard = shardFor( name );
+    boost::shared_lock<boost::shared_mutex> lock( shard.mutex );
+
+    const UpdateContext* update;
+    const visualization_msgs::InteractiveMarker* int_marker;
+    if ( !find( shard, name, update, int_marker ) )
+    {
+      return false;
+    }
+
+    pose = update ? update->pose : int_marker->pose;
+    header = update ? update->header : int_marker->header;
+  }
+
+  boost::shared_lock<boost::shared_mutex> groups_lock( groups_mutex_ );
+
+  tf::Pose absolute_pose;
+  tf::poseMsgToTF( pose, absolute_pose );
+
+  // each group can only be passed once, unless they form a loop
+  for ( size_t depth = 0; depth <= groups_.size(); depth++ )
+  {
+    M_MarkerGroup::const_iterator group_it = groups_.find( header.frame_id );
+    if ( group_it == groups_.end() )
+    {
+      tf::poseTFToMsg( absolute_pose, pose );
+      return true;
+    }
+
+    tf::Pose group_pose;
+    tf::poseMsgToTF( group_it->second.pose, group_pose );
+    absolute_pose = group_pose * absolute_pose;
+    header.frame_id = group_it->second.header.frame_id;
+  }
+
+  ROS_ERROR( "The parent frames of the groups of marker %s form a loop.", name.c_str() );
+  return false;
+}
+
+void InteractiveMarkerServer::setSeparatePoseTopic( bool separate_poses )
+{
+  boost::mutex::scoped_lock publish_lock( publish_mutex_ );
+
+  if ( separate_poses && !pose_update_pub_ )
+  {
+    pose_update_pub_ = node_handle_.advertise<visualization_msgs::InteractiveMarkerUpdate>( topic_ns_ + "/update_poses", 100 );
+  }
+  separate_poses_ = separate_poses;
+}
+
+void InteractiveMarkerServer::setCompactPoses( double position_resolution )
+{
+  boost::mutex::scoped_lock publish_lock( publish_mutex_ );
+
+  if ( position_resolution > 0.0 && !compact_pose_pub_ )
+  {
+    compact_pose_pub_ = node_handle_.advertise<std_msgs::UInt8MultiArray>( topic_ns_ + "/update_poses_compact", 100 );
+  }
+  compact_pose_resolution_ = std::max( position_resolution, 0.0 );
+}
+
+bool InteractiveMarkerServer::addPrototype( const std::string &prototype,
+    const std::vector<visualization_msgs::InteractiveMarkerControl> &controls )
+{
+  boost::unique_lock<boost::shared_mutex> lock( prototypes_mutex_ );
+
+  if ( !prototypes_.insert( std::make_pair( prototype, controls ) ).second )
+  {
+    return false;
+  }
+  if ( shared_prototypes_ )
+  {
+    publishPrototypes();
+  }
+  return true;
+}
+
+void InteractiveMarkerServer::setSharedPrototypes( bool shared )
+{
+  boost::unique_lock<boost::shared_mutex> lock( prototypes_mutex_ );
+
+  if ( shared && !prototypes_pub_ )
+  {
+    prototypes_pub_ = node_handle_.advertise<visualization_msgs::InteractiveMarkerInit>( topic_ns_ + "/prototypes", 100, true );
+  }
+  shared_prototypes_ = shared;
+  if ( shared )
+  {
+    publishPrototypes();
+  }
+}
+
+void InteractiveMarkerServer::setCompressedInit( bool compressed )
+{
+  visualization_msgs::InteractiveMarkerInitConstPtr init;
+  {
+    boost::mutex::scoped_lock publish_lock( publish_mutex_ );
+
+    if ( compressed && !compressed_init_pub_ )
+    {
+      compressed_init_pub_ = node_handle_.advertise<std_msgs::UInt8MultiArray>( topic_ns_ + "/update_full_compressed", 100, true );
+      init = last_init_;
+    }
+    else if ( !compressed && compressed_init_pub_ )
+    {
+      // the latched state would go stale otherwise
+      compressed_init_pub_.shutdown();
+      compressed_init_pub_ = ros::Publisher();
+    }
+  }
+
+  if ( init )
+  {
+    publishCompressedInit( init );
+  }
+}
+
+void InteractiveMarkerServer::setLevelsOfDetail( const std::vector<uint32_t> &max_points )
+{
+  boost::mutex::scoped_lock lock( lod_mutex_ );
+  lod_max_points_.clear();
+  for ( size_t i = 0; i < max_points.size(); i++ )
+  {
+    // no triangle list fits into zero points
+    if ( max_points[i] == 0 )
+    {
+      ROS_WARN( "Ignoring a level of detail with a maximum of 0 points." );
+      continue;
+    }
+    lod_max_points_.push_back( max_points[i] );
+  }
+  std::sort( lod_max_points_.begin(), lod_max_points_.end() );
+}
+
+void InteractiveMarkerServer::setSpatialIndex( double cell_size )
+{
+  for ( unsigned i = 0; i < num_shards_; i++ )
+  {
+    MarkerShard &shard = shards_[i];
+    boost::unique_lock<boost::shared_mutex> lock( shard.mutex );
+
+    if ( cell_size > 0.0 )
+    {
+      shard.spatial_index.reset( new SpatialGrid( cell_size ) );
+      fillSpatialIndex( shard );
+    }
+    else
+    {
+      shard.spatial_index.reset();
+    }
+  }
+}
+
+void InteractiveMarkerServer::fillSpatialIndex( MarkerShard &shard )
+{
+  // markers with pending changes are handled below
+  M_MarkerContext::const_iterator marker_context_it;
+  for ( marker_context_it = shard.marker_contexts.begin(); marker_context_it != shard.marker_contexts.end(); marker_context_it++ )
+  {
+    if ( !shard.pending_updates.count( marker_context_it->first ) )
+    {
+      const visualization_msgs::InteractiveMarker &int_marker = *marker_context_it->second.int_marker;
+      shard.spatial_index->insert( int_marker.name, int_marker.header.frame_id, int_marker.pose.position );
+    }
+  }
+
+  M_UpdateContext::const_iterator update_it;
+  for ( update_it = shard.pending_updates.begin(); update_it != shard.pending_updates.end(); update_it++ )
+  {
+    const UpdateContext* update;
+    const visualization_msgs::InteractiveMarker* int_marker;
+    if ( find( shard, update_it->first, update, int_marker ) )
+    {
+      shard.spatial_index->insert( update_it->first,
+          update ? update->header.frame_id : int_marker->header.frame_id,
+          update ? update->pose.position : int_marker->pose.position );
+    }
+  }
+}
+
+bool InteractiveMarkerServer::findInBox( const std::string &frame_id,
+    const geometry_msgs::Point &min,
+    const geometry_msgs::Point &max,
+    std::vector<visualization_msgs::InteractiveMarkerConstPtr> &int_markers ) const
+{
+  std::vector<std::string> names;
+  for ( unsigned i = 0; i < num_shards_; i++ )
+  {
+    const MarkerShard &shard = shards_[i];
+    boost::shared_lock<boost::shared_mutex> lock( shard.mutex );
+
+    if ( !shard.spatial_index )
+    {
+      return false;
+    }
+
+    names.clear();
+    shard.spatial_index->findInBox( frame_id, min, max, names );
+    for ( size_t n = 0; n < names.size(); n++ )
+    {
+      visualization_msgs::InteractiveMarkerConstPtr int_marker = getHandle( shard, names[n] );
+      if ( int_marker )
+      {
+        int_markers.push_back( int_marker );
+      }
+    }
+  }
+  return true;
+}
+
+bool InteractiveMarkerServer::findInRadius( const std::string &frame_id,
+    const geometry_msgs::Point &center,
+    double radius,
+    std::vector<visualization_msgs::InteractiveMarkerConstPtr> &int_markers ) const
+{
+  std::vector<std::string> names;
+  for ( unsigned i = 0; i < num_shards_; i++ )
+  {
+    const MarkerShard &shard = shards_[i];
+    boost::shared_lock<boost::shared_mutex> lock( shard.mutex );
+
+    if ( !shard.spatial_index )
+    {
+      return false;
+    }
+
+    names.clear();
+    shard.spatial_index->findInRadius( frame_id, center, radius, names );
+    for ( size_t n = 0; n < names.size(); n++ )
+    {
+      visualization_msgs::InteractiveMarkerConstPtr int_marker = getHandle( shard, names[n] );
+      if ( int_marker )
+      {
+        int_markers.push_back( int_marker );
+      }
+    }
+  }
+  return true;
+}
+
+void InteractiveMarkerServer::setSkipUnchanged( bool skip_unchanged, double pose_epsilon )
+{
+  for ( unsigned i = 0; i < num_shards_; i++ )
+  {
+    boost::unique_lock<boost::shared_mutex> lock( shards_[i].mutex );
+    shards_[i].skip_unchanged = skip_unchanged;
+    shards_[i].pose_epsilon = pose_epsilon;
+  }
+}
+
+uint64_t InteractiveMarkerServer::getNumSkippedUpdates() const
+{
+  uint64_t num_skipped_updates = 0;
+  for ( unsigned i = 0; i < num_shards_; i++ )
+  {
+    boost::shared_lock<boost::shared_mutex> lock( shards_[i].mutex );
+    num_skipped_updates += shards_[i].num_skipped_updates;
+  }
+  return num_skipped_updates;
+}
+
+bool InteractiveMarkerServer::find( const MarkerShard &shard, const std::string &name,
+    const UpdateContext* &update, const visualization_msgs::InteractiveMarker* &int_marker )
+{
+  update = 0;
+  int_marker = 0;
+
+  M_UpdateContext::const_iterator update_it = shard.pending_updates.find( name );
+  if ( update_it != shard.pending_updates.end() )
+  {
+    switch ( update_it->second.update_type )
+    {
+      case UpdateContext::ERASE:
+        return false;
+
+      case UpdateContext::FULL_UPDATE:
+        int_marker = update_it->second.int_marker.get();
+        return true;
+
+      case UpdateContext::POSE_UPDATE:
+      case UpdateContext::MENU_UPDATE:
+        update = &update_it->second;
+        break;
+    }
+  }
+
+  M_MarkerContext::const_iterator marker_context_it = shard.marker_contexts.find( name );
+  if ( marker_context_it == shard.marker_contexts.end() )
+  {
+    return false;
+  }
+
+  int_marker = marker_context_it->second.int_marker.get();
+  return true;
+}
+
+visualization_msgs::InteractiveMarkerConstPtr InteractiveMarkerServer::getHandle( const MarkerShard &shard, const std::string &name )
+{
+  M_UpdateContext::const_iterator update_it = shard.pending_updates.find( name );
+
+  if ( update_it != shard.pending_updates.end() )
+  {
+    switch ( update_it->second.update_type )
+    {
+      case UpdateContext::ERASE:
+        return visualization_msgs::InteractiveMarkerConstPtr();
+
+      case UpdateContext::FULL_UPDATE:
+        return update_it->second.int_marker;
+
+      case UpdateContext::POSE_UPDATE:
+      case UpdateContext::MENU_UPDATE:
+        break;
+    }
+  }
+
+  M_MarkerContext::const_iterator marker_context_it = shard.marker_contexts.find( name );
+  if ( marker_context_it == shard.marker_contexts.end() )
+  {
+    return visualization_msgs::InteractiveMarkerConstPtr();
+  }
+
+  if ( update_it == shard.pending_updates.end() )
+  {
+    return marker_context_it->second.int_marker;
+  }
+
+  // the pending change is not part of the marker yet, so we need a copy
+  visualization_msgs::InteractiveMarkerPtr int_marker =
+      boost::make_shared<visualization_msgs::InteractiveMarker>( *marker_context_it->second.int_marker );
+  mergeUpdate( update_it->second, *int_marker );
+  return int_marker;
+}
+
+void InteractiveMarkerServer::mergeUpdate( const UpdateContext &update, visualization_msgs::InteractiveMarker &int_marker )
+{
+  int_marker.pose = update.pose;
+  int_marker.header = update.header;
+  if ( update.update_type == UpdateContext::MENU_UPDATE )
+  {
+    int_marker.menu_entries = update.menu_entries;
+  }
+}
+
+visualization_msgs::InteractiveMarkerPtr InteractiveMarkerServer::getFingerprinted( const MarkerShard &shard,
+    const std::string &name, size_t &fingerprint )
+{
+  M_UpdateContext::const_iterator update_it = shard.pending_updates.find( name );
+  if ( update_it != shard.pending_updates.end() )
+  {
+    if ( update_it->second.update_type == UpdateContext::FULL_UPDATE && update_it->second.fingerprint != 0 )
+    {
+      fingerprint = update_it->second.fingerprint;
+      return update_it->second.int_marker;
+    }
+    return visualization_msgs::InteractiveMarkerPtr();
+  }
+
+  M_MarkerContext::const_iterator marker_context_it = shard.marker_contexts.find( name );
+  if ( marker_context_it != shard.marker_contexts.end() && marker_context_it->second.fingerprint != 0 )
+  {
+    fingerprint = marker_context_it->second.fingerprint;
+    return marker_context_it->second.int_marker;
+  }
+  return visualization_msgs::InteractiveMarkerPtr();
+}
+
+visualization_msgs::InteractiveMarker& InteractiveMarkerServer::mutableMarker( visualization_msgs::InteractiveMarkerPtr &int_marker )
+{
+  // someone still holds a handle returned by get(), so leave that one untouched
+  if ( !int_marker.unique() )
+  {
+    int_marker = boost::make_shared<visualization_msgs::InteractiveMarker>( *int_marker );
+  }
+  return *int_marker;
+}
+
+void InteractiveMarkerServer::getMarkers( std::vector<visualization_msgs::InteractiveMarkerConstPtr> &int_markers ) const
+{
+  for ( unsigned i = 0; i < num_shards_; i++ )
+  {
+    const MarkerShard &shard = shards_[i];
+    boost::shared_lock<boost::shared_mutex> lock( shard.mutex );
+
+    int_markers.reserve( int_markers.size() + shard.marker_contexts.size() );
+
+    M_MarkerContext::const_iterator it;
+    for ( it = shard.marker_contexts.begin(); it != shard.marker_contexts.end(); it++ )
+    {
+      int_markers.push_back( it->second.int_marker );
+    }
+  }
+}
+
+void InteractiveMarkerServer::publishInit( uint64_t seq_num,
+    const std::vector<visualization_msgs::InteractiveMarkerConstPtr> &int_markers )
+{
+  visualization_msgs::InteractiveMarkerInitPtr init =
+      boost::make_shared<visualization_msgs::InteractiveMarkerInit>();
+  init->server_id = server_id_;
+  init->seq_num = seq_num;
+  init->markers.reserve( int_markers.size() );
+
+  bool expand = !sharedPrototypes();
+  for ( size_t i = 0; i < int_markers.size(); i++ )
+  {
+    ROS_DEBUG( "Publishing %s", int_markers[i]->name.c_str() );
+    addMarker( init->markers, *int_markers[i], expand );
+  }
+
+  init_pub_.publish( init );
+
+  boost::mutex::scoped_lock publish_lock( publish_mutex_ );
+  last_init_ = init;
+  if ( compressed_init_pub_ )
+  {
+    publish_lock.unlock();
+    publishCompressedInit( init );
+    publish_lock.lock();
+  }
+
+  M_FilteredTopic::iterator it;
+  for ( it = filtered_topics_.begin(); it != filtered_topics_.end(); it++ )
+  {
+    publishFilteredInit( *it->second, int_markers );
+  }
+}
+
+void InteractiveMarkerServer::addMarker( std::vector<visualization_msgs::InteractiveMarker> &markers,
+    const visualization_msgs::InteractiveMarker &int_marker, bool expand ) const
+{
+  markers.push_back( int_marker );
+  if ( expand && usesPrototypes( int_marker ) )
+  {
+    boost::shared_lock<boost::shared_mutex> lock( prototypes_mutex_ );
+    expandPrototypes( markers.back(), prototypes_ );
+  }
+}
+
+void InteractiveMarkerServer::addFilteredMarker( std::vector<visualization_msgs::InteractiveMarker> &markers,
+    const visualization_msgs::InteractiveMarker &int_marker,
+    const LevelsOfDetailConstPtr &levels_of_detail,
+    const InterestFilter &filter ) const
+{
+  if ( filter.max_points == 0 || !levels_of_detail )
+  {
+    addMarker( markers, int_marker, true );
+    return;
+  }
+
+  // the finest level that is small enough, or the coarsest one
+  M_LevelOfDetail::const_iterator level_it = levels_of_detail->upper_bound( filter.max_points );
+  if ( level_it != levels_of_detail->begin() )
+  {
+    level_it--;
+  }
+
+  // copy everything but the full controls
+  markers.push_back( visualization_msgs::InteractiveMarker() );
+  visualization_msgs::InteractiveMarker &filtered_marker = markers.back();
+  filtered_marker.header = int_marker.header;
+  filtered_marker.pose = int_marker.pose;
+  filtered_marker.name = int_marker.name;
+  filtered_marker.description = int_marker.description;
+  filtered_marker.scale = int_marker.scale;
+  filtered_marker.menu_entries = int_marker.menu_entries;
+  filtered_marker.controls.reserve( int_marker.controls.size() );
+  for ( size_t c = 0; c < int_marker.controls.size(); c++ )
+  {
+    M_DecimatedControl::const_iterator control_it = level_it->second.find( c );
+    filtered_marker.controls.push_back( control_it != level_it->second.end() ? control_it->second : int_marker.controls[c] );
+  }
+
+  if ( usesPrototypes( filtered_marker ) )
+  {
+    boost::shared_lock<boost::shared_mutex> lock( prototypes_mutex_ );
+    expandPrototypes( filtered_marker, prototypes_ );
+  }
+}
+
+InteractiveMarkerServer::LevelsOfDetailConstPtr InteractiveMarkerServer::makeLevelsOfDetail(
+    const visualization_msgs::InteractiveMarker &int_marker ) const
+{
+  std::vector<uint32_t> lod_max_points;
+  {
+    boost::mutex::scoped_lock lock( lod_mutex_ );
+    lod_max_points = lod_max_points_;
+  }
+
+  boost::shared_ptr<M_LevelOfDetail> levels_of_detail;
+  for ( size_t l = 0; l < lod_max_points.size(); l++ )
+  {
+    // only controls with a decimated marker are copied
+    M_DecimatedControl controls;
+    for ( size_t c = 0; c < int_marker.controls.size(); c++ )
+    {
+      const visualization_msgs::InteractiveMarkerControl &control = int_marker.controls[c];
+      visualization_msgs::InteractiveMarkerControl *decimated_control = 0;
+      for ( size_t m = 0; m < control.markers.size(); m++ )
+      {
+        visualization_msgs::Marker marker;
+        if ( decimateTriangleList( control.markers[m], lod_max_points[l], marker ) )
+        {
+          if ( !decimated_control )
+          {
+            decimated_control = &( controls[c] = control );
+          }
+          decimated_control->markers[m].points.swap( marker.points );
+          decimated_control->markers[m].colors.swap( marker.colors );
+        }
+      }
+    }
+
+    // levels that change nothing are the same as the full controls
+    if ( controls.empty() )
+    {
+      continue;
+    }
+    if ( !levels_of_detail )
+    {
+      levels_of_detail = boost::make_shared<M_LevelOfDetail>();
+    }
+    (*levels_of_detail)[ lod_max_points[l] ].swap( controls );
+  }
+
+  return levels_of_detail;
+}
+
+InteractiveMarkerServer::LevelsOfDetailConstPtr InteractiveMarkerServer::getLevelsOfDetail( const std::string &name ) const
+{
+  const MarkerShard &shard = shardFor( name );
+  boost::shared_lock<boost::shared_mutex> lock( shard.mutex );
+
+  M_MarkerContext::const_iterator marker_context_it = shard.marker_contexts.find( name );
+  if ( marker_context_it == shard.marker_contexts.end() )
+  {
+    return LevelsOfDetailConstPtr();
+  }
+  return marker_context_it->second.levels_of_detail;
+}
+
+bool InteractiveMarkerServer::sharedPrototypes() const
+{
+  boost::shared_lock<boost::shared_mutex> lock( prototypes_mutex_ );
+  return shared_prototypes_;
+}
+
+void InteractiveMarkerServer::publishPrototypes()
+{
+  // prototypes go out as markers that only have the shared controls
+  visualization_msgs::InteractiveMarkerInitPtr prototypes =
+      boost::make_shared<visualization_msgs::InteractiveMarkerInit>();
+  prototypes->server_id = server_id_;
+  prototypes->markers.reserve( prototypes_.size() );
+
+  M_Prototype::const_iterator it;
+  for ( it = prototypes_.begin(); it != prototypes_.end(); it++ )
+  {
+    prototypes->markers.push_back( visualization_msgs::InteractiveMarker() );
+    prototypes->markers.back().name = it->first;
+    prototypes->markers.back().controls = it->second;
+  }
+
+  prototypes_pub_.publish( prototypes );
+}
+
+void InteractiveMarkerServer::publishCompressedInit( const visualization_msgs::InteractiveMarkerInitConstPtr &init )
+{
+  // compressing a large state takes a while, so keep it out of publish_mutex_
+  std_msgs::UInt8MultiArrayPtr msg = boost::make_shared<std_msgs::UInt8MultiArray>();
+  if ( !compressInit( *init, msg->data, INIT_COMPRESSION_LEVEL ) )
+  {
+    ROS_ERROR( "Could not compress the init message with sequence number %lu.", (unsigned long)init->seq_num );
+    return;
+  }
+
+  // a newer state may have been published in the meantime and must not be
+  // overwritten on the latched topic
+  boost::mutex::scoped_lock publish_lock( publish_mutex_ );
+  if ( compressed_init_pub_ && last_init_ == init )
+  {
+    compressed_init_pub_.publish( msg );
+  }
+}
+
+void InteractiveMarkerServer::publishFilteredInit( FilteredTopic &topic,
+    const std::vector<visualization_msgs::InteractiveMarkerConstPtr> &int_markers )
+{
+  visualization_msgs::InteractiveMarkerInitPtr init =
+      boost::make_shared<visualization_msgs::InteractiveMarkerInit>();
+  init->server_id = server_id_;
+  init->seq_num = topic.seq_num;
+
+  topic.visible.clear();
+  for ( size_t i = 0; i < int_markers.size(); i++ )
+  {
+    const visualization_msgs::InteractiveMarker &int_marker = *int_markers[i];
+    if ( matches( topic.filter, int_marker.name, int_marker.header, int_marker.pose ) )
+    {
+      LevelsOfDetailConstPtr levels_of_detail;
+      if ( topic.filter.max_points > 0 )
+      {
+        levels_of_detail = getLevelsOfDetail( int_marker.name );
+      }
+      addFilteredMarker( init->markers, int_marker, levels_of_detail, topic.filter );
+      topic.visible.insert( int_marker.name );
+    }
+  }
+
+  topic.init_pub.publish( init );
+}
+
+void InteractiveMarkerServer::processFeedback( const FeedbackConstPtr& feedback )
+{
+  MarkerShard &shard = shardFor( feedback->marker_name );
+  boost::unique_lock<boost::shared_mutex> lock( shard.mutex );
+
+  M_MarkerContext::iterator marker_context_it = shard.marker_contexts.find( feedback->marker_name );
+
+  // ignore feedback for non-existing markers
+  if ( marker_context_it == shard.marker_contexts.end() )
+  {
+    return;
+  }
+
+  MarkerContext &marker_context = marker_context_it->second;
+
+  // if two callers try to modify the same marker, reject (timeout= 1 sec)
+  if ( marker_context.last_client_id != feedback->client_id &&
+      (ros::Time::now() - marker_context.last_feedback).toSec() < 1.0 )
+  {
+    ROS_DEBUG( "Rejecting feedback for %s: conflicting feedback from separate clients.", feedback->marker_name.c_str() );
+    return;
+  }
+
+  marker_context.last_feedback = ros::Time::now();
+  marker_context.last_client_id = feedback->client_id;
+
+  if ( feedback->event_type == visualization_msgs::InteractiveMarkerFeedback::POSE_UPDATE )
+  {
+    if ( marker_context.int_marker->header.stamp == ros::Time(0) )
+    {
+      // keep the old header
+      doSetPose( shard, shard.pending_updates.find( feedback->marker_name ), feedback->marker_name, feedback->pose, marker_context.int_marker->header );
+    }
+    else
+    {
+      doSetPose( shard, shard.pending_updates.find( feedback->marker_name ), feedback->marker_name, feedback->pose, feedback->header );
+    }
+  }
+
+  if ( !marker_context.feedback_cbs )
+  {
+    return;
+  }
+
+  // call type-specific or default feedback handler.
+  // the callback may modify the server, so release the lock first.
+  FeedbackCallbackPtr feedback_cb = marker_context.feedback_cbs->get( feedback->event_type );
+  lock.unlock();
+
+  if ( feedback_cb )
+  {
+    dispatchFeedback( feedback_cb, feedback );
+  }
+}
+
+
+void InteractiveMarkerServer::dispatchFeedback( const FeedbackCallbackPtr& feedback_cb, const FeedbackConstPtr& feedback )
+{
+  boost::mutex::scoped_lock feedback_lock( feedback_mutex_ );
+  feedback_queue_.push_back( std::make_pair( feedback_cb, feedback ) );
+  if ( dispatching_feedback_ )
+  {
+    return;
+  }
+
+  dispatching_feedback_ = true;
+  while ( !feedback_queue_.empty() )
+  {
+    std::pair<FeedbackCallbackPtr, FeedbackConstPtr> next = feedback_queue_.front();
+    feedback_queue_.pop_front();
+    feedback_lock.unlock();
+
+    try
+    {
+      (*next.first)( next.second );
+    }
+    catch ( ... )
+    {
+      feedback_lock.lock();
+      dispatching_feedback_ = false;
+      throw;
+    }
+
+    feedback_lock.lock();
+  }
+  dispatching_feedback_ = false;
+}
+
+
+void InteractiveMarkerServer::keepAlive()
+{
+  // tf is not latched, so listeners that start later need the group frames again
+  std::vector<std::string> group_frames;
+  std::vector<geometry_msgs::Pose> group_poses;
+  std::vector<std_msgs::Header> group_headers;
+  {
+    boost::shared_lock<boost::shared_mutex> groups_lock( groups_mutex_ );
+    M_MarkerGroup::const_iterator it;
+    for ( it = groups_.begin(); it != groups_.end(); it++ )
+    {
+      // changed groups wait for the next applyChanges()
+      if ( !it->second.changed )
+      {
+        group_frames.push_back( it->first );
+        group_poses.push_back( it->second.pose );
+        group_headers.push_back( it->second.header );
+      }
+    }
+  }
+  publishGroupTransforms( group_frames, group_poses, group_headers );
+
+  boost::mutex::scoped_lock publish_lock( publish_mutex_ );
+
+  // any update keeps the clients happy as well
+  if ( (ros::Time::now() - last_publish_time_).toSec() >= KEEP_ALIVE_PERIOD )
+  {
+    visualization_msgs::InteractiveMarkerUpdatePtr empty_update =
+        boost::make_shared<visualization_msgs::InteractiveMarkerUpdate>();
+    empty_update->type = visualization_msgs::InteractiveMarkerUpdate::KEEP_ALIVE;
+    publish( empty_update );
+  }
+
+  // filtered topics may not have received the last updates
+  M_FilteredTopic::iterator it;
+  for ( it = filtered_topics_.begin(); it != filtered_topics_.end(); it++ )
+  {
+    FilteredTopic &topic = *it->second;
+    if ( (ros::Time::now() - topic.last_publish_time).toSec() < KEEP_ALIVE_PERIOD )
+    {
+      continue;
+    }
+
+    visualization_msgs::InteractiveMarkerUpdatePtr filtered_keep_alive =
+        boost::make_shared<visualization_msgs::InteractiveMarkerUpdate>();
+    filtered_keep_alive->type = visualization_msgs::InteractiveMarkerUpdate::KEEP_ALIVE;
+    filtered_keep_alive->server_id = server_id_;
+    filtered_keep_alive->seq_num = topic.seq_num;
+    topic.update_pub.publish( filtered_keep_alive );
+    topic.last_publish_time = ros::Time::now();
+  }
+}
+
+
+InteractiveMarkerServer::MarkerShard& InteractiveMarkerServer::shardFor( const std::string &name ) const
+{
+  return shards_[ boost::hash<std::string>()( name ) % num_shards_ ];
+}
+
+
+void InteractiveMarkerServer::publish( const visualization_msgs::InteractiveMarkerUpdatePtr &update )
+{
+  // the message may be shared with intra-process subscribers once
+  // published, so it must not be modified afterwards
+  update->server_id = server_id_;
+  update->seq_num = published_seq_num_;
+  update_pub_.publish( update );
+  last_publish_time_ = ros::Time::now();
+}
+
+
+void InteractiveMarkerServer::publishTransforms()
+{
+  // publish tf update_it->second.int_marker.pose -> feedback->marker_name;
+  for ( unsigned i = 0; i < num_shards_; i++ )
+  {
+    const MarkerShard &shard = shards_[i];
+    boost::shared_lock<boost::shared_mutex> lock( shard.mutex );
+    for(M_MarkerContext::const_iterator it = shard.marker_contexts.begin(); it != shard.marker_contexts.end(); it++) {
+      ROS_DEBUG( "Markers '%s' publish tf from ~%s to %s",
+                 it->first.c_str(),
+                 it->second.int_marker->header.frame_id.c_str(),
+                 it->second.int_marker->name.c_str() );
+      static tf::TransformBroadcaster br;
+      tf::Transform transform;
+      geometry_msgs::Pose pose;
+      pose = it->second.int_marker->pose;
+
+      transform.setOrigin( tf::Vector3( pose.position.x,
+                                        pose.position.y,
+                                        pose.position.z ));
+
+      if( (pose.orientation.x =! pose.orientation.x) ||
+          (pose.orientation.y =! pose.orientation.y) ||
+          (pose.orientation.z =! pose.orientation.z) ||
+          (pose.orientation.w =! pose.orientation.w) ){
+        transform.setRotation( tf::Quaternion( 0,
+                                               0,
+                                               0,
+                                               1 ));
+      }else{
+        transform.setRotation( tf::Quaternion( pose.orientation.x,
+                                               pose.orientation.y,
+                                               pose.orientation.z,
+                                               pose.orientation.w ));
+      }
+
+      br.sendTransform( tf::StampedTransform( transform,
+                                              ros::Time::now(),
+                                              it->second.int_marker->header.frame_id,
+                                              it->second.int_marker->name ));
+    }
+  }
+}
+
+
+void InteractiveMarkerServer::publishGroupTransforms( const std::vector<std::string> &group_frames,
+    const std::vector<geometry_msgs::Pose> &group_poses,
+    const std::vector<std_msgs::Header> &group_headers )
+{
+  if ( group_frames.empty() )
+  {
+    return;
+  }
+
+  static tf::TransformBroadcaster br;
+  std::vector<tf::StampedTransform> transforms;
+  transforms.reserve( group_frames.size() );
+
+  ros::Time now = ros::Time::now();
+  for ( size_t i = 0; i < group_frames.size(); i++ )
+  {
+    tf::Transform transform;
+    tf::poseMsgToTF( group_poses[i], transform );
+    transforms.push_back( tf::StampedTransform( transform, now, group_headers[i].frame_id, group_frames[i] ) );
+  }
+
+  br.sendTransform( transforms );
+}
+
+
+void InteractiveMarkerServer::doSetPose( MarkerShard &shard, M_UpdateContext::iterator update_it, const std::string &name, const geometry_msgs::Pose &pose, const std_msgs::Header &header )
+{
+  if ( update_it == shard.pending_updates.end() )
+  {
+    update_it = shard.pending_updates.insert( std::make_pair( name, UpdateContext() ) ).first;
+    update_it->second.update_type = UpdateContext::POSE_UPDATE;
+  }
+  else if ( update_it->second.update_type != UpdateContext::FULL_UPDATE &&
+            update_it->second.update_type != UpdateContext::MENU_UPDATE )
+  {
+    update_it->second.update_type = UpdateContext::POSE_UPDATE;
+  }
+  update_it->second.held = false;
+
+  if ( update_it->second.update_type == UpdateContext::FULL_UPDATE )
+  {
+    visualization_msgs::InteractiveMarker &int_marker = mutableMarker( update_it->second.int_marker );
+    int_marker.pose = pose;
+    int_marker.header = header;
+    update_it->second.fingerprint = 0;
+  }
+  else
+  {
+    update_it->second.pose = pose;
+    update_it->second.header = header;
+  }
+
+  if ( shard.spatial_index )
+  {
+    shard.spatial_index->insert( name, header.frame_id, pose.position );
+  }
+  ROS_DEBUG( "Marker '%s' is now at %f, %f, %f", update_it->first.c_str(), pose.position.x, pose.position.y, pose.position.z );
+}
+
+bool InteractiveMarkerServer::doSetCallback( MarkerShard &shard, M_MarkerContext::iterator marker_context_it,
+    M_UpdateContext::iterator update_it, const FeedbackCallbackPtr &feedback_cb, uint8_t feedback_type )
+{
+  if ( !FeedbackCallbackTable::hasSlot( feedback_type ) )
+  {
+    ROS_ERROR( "Cannot set callback for unknown feedback type %u.", (unsigned)feedback_type );
+    return false;
+  }
+
+  // we need to overwrite both the callbacks for the actual marker
+  // and the update, if there's any
+
+  if ( marker_context_it != shard.marker_contexts.end() )
+  {
+    marker_context_it->second.feedback_cbs =
+        replaceCallback( shard, marker_context_it->second.feedback_cbs, feedback_cb, feedback_type );
+  }
+
+  if ( update_it != shard.pending_updates.end() )
+  {
+    update_it->second.feedback_cbs =
+        replaceCallback( shard, update_it->second.feedback_cbs, feedback_cb, feedback_type );
+  }
+  return true;
+}
+
+
+InteractiveMarkerServer::FeedbackCallbackTablePtr InteractiveMarkerServer::replaceCallback( MarkerShard &shard,
+    const FeedbackCallbackTablePtr &feedback_cbs, const FeedbackCallbackPtr &feedback_cb, uint8_t feedback_type )
+{
+  if ( shard.last_replacement_cbs &&
+       feedback_cbs == shard.last_replaced_cbs &&
+       feedback_cb == shard.last_replacement_cb &&
+       feedback_type == shard.last_replacement_type )
+  {
+    return shard.last_replacement_cbs;
+  }
+
+  boost::shared_ptr<FeedbackCallbackTable> replacement = feedback_cbs ?
+      boost::make_shared<FeedbackCallbackTable>( *feedback_cbs ) :
+      boost::make_shared<FeedbackCallbackTable>();
+  replacement->set( feedback_type, feedback_cb );
+
+  shard.last_replaced_cbs = feedback_cbs;
+  shard.last_replacement_cbs = replacement;
+  shard.last_replacement_cb = feedback_cb;
+  shard.last_replacement_type = feedback_type;
+
+  return replacement;
+}
+
+
+bool InteractiveMarkerServer::FeedbackCallbackTable::hasSlot( uint8_t feedback_type )
+{
+  return feedback_type < NUM_SLOTS-1 || feedback_type == DEFAULT_FEEDBACK_CB;
+}
+
+
+void InteractiveMarkerServer::FeedbackCallbackTable::set( uint8_t feedback_type, const FeedbackCallbackPtr &feedback_cb )
+{
+  if ( feedback_type == DEFAULT_FEEDBACK_CB )
+  {
+    slots_[NUM_SLOTS-1] = feedback_cb;
+  }
+  else
+  {
+    slots_[feedback_type] = feedback_cb;
+  }
+}
+
+
+const InteractiveMarkerServer::FeedbackCallbackPtr& InteractiveMarkerServer::FeedbackCallbackTable::get( uint8_t feedback_type ) const
+{
+  if ( feedback_type < NUM_SLOTS-1 && slots_[feedback_type] )
+  {
+    return slots_[feedback_type];
+  }
+  return slots_[NUM_SLOTS-1];
+}
+
+
+bool InteractiveMarkerServer::doSetMenuEntries( MarkerShard &shard, M_MarkerContext::iterator marker_context_it,
+    M_UpdateContext::iterator &update_it, const std::string &name,
+    const std::vector<visualization_msgs::MenuEntry> &menu_entries )
+{
+  if ( update_it != shard.pending_updates.end() )
+  {
+    switch ( update_it->second.update_type )
+    {
+      case UpdateContext::ERASE:
+        return false;
+
+      case UpdateContext::FULL_UPDATE:
+        mutableMarker( update_it->second.int_marker ).menu_entries = menu_entries;
+        update_it->second.fingerprint = 0;
+        return true;
+
+      case UpdateContext::MENU_UPDATE:
+        // the pending update already carries pose and header
+        update_it->second.menu_entries = menu_entries;
+        return true;
+
+      case UpdateContext::POSE_UPDATE:
+        // keep the pending pose & header, add the menu
+        update_it->second.update_type = UpdateContext::MENU_UPDATE;
+        update_it->second.held = false;
+        update_it->second.menu_entries = menu_entries;
+        return true;
+    }
+  }
+
+  if ( marker_context_it == shard.marker_contexts.end() )
+  {
+    return false;
+  }
+
+  update_it = shard.pending_updates.insert( std::make_pair( name, UpdateContext() ) ).first;
+  update_it->second.update_type = UpdateContext::MENU_UPDATE;
+  update_it->second.pose = marker_context_it->second.int_marker->pose;
+  update_it->second.header = marker_context_it->second.int_marker->header;
+  update_it->second.menu_entries = menu_entries;
+  return true;
 }
 
 
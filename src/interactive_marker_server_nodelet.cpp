@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "interactive_markers/interactive_marker_server_nodelet.h"
+
+#include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
+
+namespace interactive_markers
+{
+
+namespace
+{
+
+boost::mutex shared_executor_mutex;
+boost::weak_ptr<InteractiveMarkerExecutor> shared_executor;
+
+// executor used by all server nodelets in this process.
+// It is destroyed when the last of them has been unloaded.
+boost::shared_ptr<InteractiveMarkerExecutor> getSharedExecutor()
+{
+  boost::mutex::scoped_lock lock( shared_executor_mutex );
+  boost::shared_ptr<InteractiveMarkerExecutor> executor = shared_executor.lock();
+  if ( !executor )
+  {
+    executor.reset( new InteractiveMarkerExecutor( 0 ) );
+    shared_executor = executor;
+  }
+  return executor;
+}
+
+}
+
+InteractiveMarkerServerNodelet::~InteractiveMarkerServerNodelet()
+{
+  server_.reset();
+  executor_.reset();
+}
+
+InteractiveMarkerServer& InteractiveMarkerServerNodelet::getServer()
+{
+  return *server_;
+}
+
+void InteractiveMarkerServerNodelet::onInit()
+{
+  ros::NodeHandle& private_nh = getPrivateNodeHandle();
+
+  std::string topic_ns;
+  std::string server_id;
+  int num_shards;
+  private_nh.param<std::string>( "topic_ns", topic_ns, getName() );
+
+  // the server id is appended to the node name, so leave out the namespace
+  const std::string &name = getName();
+  private_nh.param<std::string>( "server_id", server_id, name.substr( name.rfind( '/' ) + 1 ) );
+  private_nh.param<int>( "num_shards", num_shards, 1 );
+
+  executor_ = getSharedExecutor();
+  server_.reset( new InteractiveMarkerServer( topic_ns, server_id, *executor_,
+      num_shards > 0 ? num_shards : 1 ) );
+
+  onInitServer();
+}
+
+}
@@ -38,7 +38,8 @@ namespace interactive_markers
 {
 
 MenuHandler::MenuHandler() :
-    current_handle_(1)
+    current_handle_(1),
+    menu_entries_dirty_(true)
 {
 
 }
@@ -101,6 +102,7 @@ bool MenuHandler::setVisible( EntryHandle handle, bool visible )
   }
 
   context->second.visible = visible;
+  menu_entries_dirty_ = true;
   return true;
 }
 
@@ -116,6 +118,7 @@ bool MenuHandler::setCheckState( EntryHandle handle, CheckState check_state )
   }
 
   context->second.check_state = check_state;
+  menu_entries_dirty_ = true;
   return true;
 }
 
@@ -138,25 +141,29 @@ bool MenuHandler::getCheckState( EntryHandle handle, CheckState &check_state ) c
 
 bool MenuHandler::apply( InteractiveMarkerServer &server, const std::string &marker_name )
 {
-  visualization_msgs::InteractiveMarker int_marker;
-
-  if ( !server.get( marker_name, int_marker ) )
+  if ( !server.setMenuEntries( marker_name, getMenuEntries() ) )
   {
     // This marker has been deleted on the server, so forget it.
     managed_markers_.erase( marker_name );
     return false;
   }
 
-  int_marker.menu_entries.clear();
-
-  pushMenuEntries( top_level_handles_, int_marker.menu_entries, 0 );
-
-  server.insert( int_marker );
   server.setCallback( marker_name, boost::bind( &MenuHandler::processFeedback, this, _1 ), visualization_msgs::InteractiveMarkerFeedback::MENU_SELECT );
   managed_markers_.insert( marker_name );
   return true;
 }
 
+const std::vector<visualization_msgs::MenuEntry>& MenuHandler::getMenuEntries()
+{
+  if ( menu_entries_dirty_ )
+  {
+    menu_entries_.clear();
+    pushMenuEntries( top_level_handles_, menu_entries_, 0 );
+    menu_entries_dirty_ = false;
+  }
+  return menu_entries_;
+}
+
 bool MenuHandler::pushMenuEntries( std::vector<EntryHandle>& handles_in,
                                    std::vector<visualization_msgs::MenuEntry>& entries_out,
                                    EntryHandle parent_handle )
@@ -191,16 +198,16 @@ bool MenuHandler::pushMenuEntries( std::vector<EntryHandle>& handles_in,
 
 bool MenuHandler::reApply( InteractiveMarkerServer &server )
 {
-  bool success = true;
-  std::set<std::string>::iterator it = managed_markers_.begin();
-  while ( it != managed_markers_.end() )
+  std::vector<std::string> marker_names( managed_markers_.begin(), managed_markers_.end() );
+  std::vector<std::string> missing_names;
+
+  bool success = server.setMenuEntries( marker_names, getMenuEntries(),
+      boost::bind( &MenuHandler::processFeedback, this, _1 ), missing_names );
+
+  // These markers have been deleted on the server, so forget them.
+  for ( size_t i = 0; i < missing_names.size(); i++ )
   {
-    // apply() may delete the entry "it" is pointing to, so
-    // pre-compute the next iterator.
-    std::set<std::string>::iterator next_it = it;
-    next_it++;
-    success = apply( server, *it ) && success;
-    it = next_it;
+    managed_markers_.erase( missing_names[i] );
   }
   return success;
 }
@@ -222,6 +229,7 @@ MenuHandler::EntryHandle MenuHandler::doInsert( const std::string &title,
   context.feedback_cb = feedback_cb;
 
   entry_contexts_[handle] = context;
+  menu_entries_dirty_ = true;
   return handle;
 }
 
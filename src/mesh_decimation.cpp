@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "interactive_markers/detail/mesh_decimation.h"
+
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <algorithm>
+#include <math.h>
+
+namespace interactive_markers
+{
+
+namespace
+{
+
+// gives up growing the cells after this many tries, which is
+// far more than enough to collapse any mesh into a single cell
+const unsigned MAX_DECIMATION_STEPS = 64;
+
+struct Cell
+{
+  int64_t x, y, z;
+
+  bool operator==( const Cell &other ) const
+  {
+    return x == other.x && y == other.y && z == other.z;
+  }
+};
+
+size_t hash_value( const Cell &cell )
+{
+  size_t seed = 0;
+  boost::hash_combine( seed, cell.x );
+  boost::hash_combine( seed, cell.y );
+  boost::hash_combine( seed, cell.z );
+  return seed;
+}
+
+// the merged vertices of one cell
+struct Cluster
+{
+  Cluster() : num_points(0), r(0), g(0), b(0), a(0) {}
+  geometry_msgs::Point sum;
+  size_t num_points;
+  double r, g, b, a;
+};
+
+}
+
+void clusterVertices( visualization_msgs::Marker &marker, double cell_size )
+{
+  size_t num_triangles = marker.points.size() / 3;
+  bool has_colors = marker.colors.size() == marker.points.size();
+  bool has_triangle_colors = !has_colors && marker.colors.size() * 3 == marker.points.size();
+
+  // the cluster of each point
+  boost::unordered_map<Cell, size_t> cluster_indices;
+  std::vector<Cluster> clusters;
+  std::vector<size_t> point_clusters( num_triangles * 3 );
+
+  for ( size_t i = 0; i < num_triangles * 3; i++ )
+  {
+    const geometry_msgs::Point &point = marker.points[i];
+    Cell cell = { int64_t( floor( point.x / cell_size ) ),
+                  int64_t( floor( point.y / cell_size ) ),
+                  int64_t( floor( point.z / cell_size ) ) };
+
+    std::pair<boost::unordered_map<Cell, size_t>::iterator, bool> inserted =
+        cluster_indices.insert( std::make_pair( cell, clusters.size() ) );
+    if ( inserted.second )
+    {
+      clusters.push_back( Cluster() );
+    }
+    point_clusters[i] = inserted.first->second;
+
+    Cluster &cluster = clusters[ point_clusters[i] ];
+    cluster.sum.x += point.x;
+    cluster.sum.y += point.y;
+    cluster.sum.z += point.z;
+    cluster.num_points++;
+    if ( has_colors )
+    {
+      cluster.r += marker.colors[i].r;
+      cluster.g += marker.colors[i].g;
+      cluster.b += marker.colors[i].b;
+      cluster.a += marker.colors[i].a;
+    }
+  }
+
+  std::vector<geometry_msgs::Point> points;
+  std::vector<std_msgs::ColorRGBA> colors;
+  for ( size_t t = 0; t < num_triangles; t++ )
+  {
+    size_t c0 = point_clusters[3*t], c1 = point_clusters[3*t+1], c2 = point_clusters[3*t+2];
+    if ( c0 == c1 || c1 == c2 || c0 == c2 )
+    {
+      continue;
+    }
+
+    if ( has_triangle_colors )
+    {
+      colors.push_back( marker.colors[t] );
+    }
+    for ( int v = 0; v < 3; v++ )
+    {
+      const Cluster &cluster = clusters[ point_clusters[3*t+v] ];
+      geometry_msgs::Point point;
+      point.x = cluster.sum.x / cluster.num_points;
+      point.y = cluster.sum.y / cluster.num_points;
+      point.z = cluster.sum.z / cluster.num_points;
+      points.push_back( point );
+      if ( has_colors )
+      {
+        std_msgs::ColorRGBA color;
+        color.r = cluster.r / cluster.num_points;
+        color.g = cluster.g / cluster.num_points;
+        color.b = cluster.b / cluster.num_points;
+        color.a = cluster.a / cluster.num_points;
+        colors.push_back( color );
+      }
+    }
+  }
+
+  marker.points.swap( points );
+  marker.colors.swap( colors );
+}
+
+bool decimateTriangleList( const visualization_msgs::Marker &marker,
+    size_t max_points, visualization_msgs::Marker &decimated )
+{
+  if ( marker.type != visualization_msgs::Marker::TRIANGLE_LIST || marker.points.size() <= max_points )
+  {
+    return false;
+  }
+  if ( max_points == 0 )
+  {
+    decimated = marker;
+    decimated.points.clear();
+    decimated.colors.clear();
+    return true;
+  }
+
+  geometry_msgs::Point min = marker.points[0];
+  geometry_msgs::Point max = marker.points[0];
+  for ( size_t i = 1; i < marker.points.size(); i++ )
+  {
+    const geometry_msgs::Point &point = marker.points[i];
+    min.x = std::min( min.x, point.x );
+    min.y = std::min( min.y, point.y );
+    min.z = std::min( min.z, point.z );
+    max.x = std::max( max.x, point.x );
+    max.y = std::max( max.y, point.y );
+    max.z = std::max( max.z, point.z );
+  }
+  double extent = std::max( max.x - min.x, std::max( max.y - min.y, max.z - min.z ) );
+  if ( extent <= 0.0 )
+  {
+    extent = 1.0;
+  }
+
+  // the number of points on a surface falls with the square of the cell size,
+  // so scale the cells by the square root of how far off the target we are
+  double cell_size = extent / sqrt( double( max_points ) );
+  for ( unsigned step = 0; step < MAX_DECIMATION_STEPS; step++ )
+  {
+    decimated = marker;
+    clusterVertices( decimated, cell_size );
+    if ( decimated.points.size() <= max_points )
+    {
+      return true;
+    }
+    cell_size *= std::max( 1.2, sqrt( double( decimated.points.size() ) / max_points ) );
+  }
+
+  // only reached for degenerate input, an empty mesh always fits
+  decimated = marker;
+  decimated.points.clear();
+  decimated.colors.clear();
+  return true;
+}
+
+}
@@ -44,21 +44,53 @@ template<class MsgT>
 MessageContext<MsgT>::MessageContext(
     tf::Transformer& tf,
     const std::string& target_frame,
-    const typename MsgT::ConstPtr& _msg)
-: tf_(tf)
+    const typename MsgT::ConstPtr& _msg,
+    const M_Prototype* prototypes)
+: msg(_msg)
+, prototypes_(prototypes)
+, tf_(tf)
 , target_frame_(target_frame)
 {
-  // copy message, as we will be modifying it
-  msg = boost::make_shared<MsgT>( *_msg );
-
+  // the message is shared with the sender when it was published within
+  // the same process, so it is only copied once it needs to change
   init();
 }
 
+template<class MsgT>
+MsgT& MessageContext<MsgT>::mutableMsg()
+{
+  if ( !mutable_msg_ )
+  {
+    mutable_msg_ = boost::make_shared<MsgT>( *msg );
+    msg = mutable_msg_;
+  }
+  return *mutable_msg_;
+}
+
+template<class MsgT>
+MessageContext<MsgT>::MessageContext( const MessageContext<MsgT>& other )
+: msg(other.msg)
+, open_marker_idx_(other.open_marker_idx_)
+, open_pose_idx_(other.open_pose_idx_)
+, open_prototype_idx_(other.open_prototype_idx_)
+, prototypes_(other.prototypes_)
+, tf_(other.tf_)
+, target_frame_(other.target_frame_)
+{
+  // mutable_msg_ stays empty, so that the first change makes our own copy
+}
+
 template<class MsgT>
 MessageContext<MsgT>& MessageContext<MsgT>::operator=( const MessageContext<MsgT>& other )
 {
+  // the indices refer to the message, so it has to come along. The
+  // writable copy stays with other, we make our own on the first change.
+  msg = other.msg;
+  mutable_msg_.reset();
   open_marker_idx_ = other.open_marker_idx_;
   open_pose_idx_ = other.open_pose_idx_;
+  open_prototype_idx_ = other.open_prototype_idx_;
+  prototypes_ = other.prototypes_;
   target_frame_ = other.target_frame_;
   return *this;
 }
@@ -145,20 +177,32 @@ void MessageContext<MsgT>::getTfTransforms( std::vector<visualization_msgs::Inte
   }
 }
 
-template<class MsgT>
-void MessageContext<MsgT>::getTfTransforms( std::vector<visualization_msgs::InteractiveMarkerPose>& msg_vec, std::list<size_t>& indices )
+// only update messages contain poses
+template<>
+void MessageContext<visualization_msgs::InteractiveMarkerUpdate>::getPoseTfTransforms( std::list<size_t>& indices )
 {
   std::list<size_t>::iterator idx_it;
   for ( idx_it = indices.begin(); idx_it != indices.end(); )
   {
-    visualization_msgs::InteractiveMarkerPose& msg = msg_vec[ *idx_it ];
-    if ( getTransform( msg.header, msg.pose ) )
+    // work on a copy, so that the message is only copied if the pose changes
+    std_msgs::Header header = msg->poses[ *idx_it ].header;
+    geometry_msgs::Pose pose = msg->poses[ *idx_it ].pose;
+    bool success = getTransform( header, pose );
+
+    if ( success && header.frame_id != msg->poses[ *idx_it ].header.frame_id )
+    {
+      visualization_msgs::InteractiveMarkerPose& pose_msg = mutableMsg().poses[ *idx_it ];
+      pose_msg.header = header;
+      pose_msg.pose = pose;
+    }
+
+    if ( success )
     {
       idx_it = indices.erase(idx_it);
     }
     else
     {
-      DBG_MSG( "Transform %s -> %s at time %f is not ready.", msg.header.frame_id.c_str(), target_frame_.c_str(), msg.header.stamp.toSec() );
+      DBG_MSG( "Transform %s -> %s at time %f is not ready.", header.frame_id.c_str(), target_frame_.c_str(), header.stamp.toSec() );
       ++idx_it;
     }
   }
@@ -167,7 +211,71 @@ void MessageContext<MsgT>::getTfTransforms( std::vector<visualization_msgs::Inte
 template<class MsgT>
 bool MessageContext<MsgT>::isReady()
 {
-  return open_marker_idx_.empty() && open_pose_idx_.empty();
+  return open_marker_idx_.empty() && open_pose_idx_.empty() && open_prototype_idx_.empty();
+}
+
+template<class MsgT>
+void MessageContext<MsgT>::completeMarkers()
+{
+  if ( msg->markers.empty() )
+  {
+    return;
+  }
+
+  for ( size_t i=0; i<msg->markers.size(); i++ )
+  {
+    if ( !usesPrototypes( msg->markers[i] ) )
+    {
+      continue;
+    }
+    if ( prototypes_ && prototypesKnown( msg->markers[i], *prototypes_ ) )
+    {
+      expandPrototypes( mutableMsg().markers[i], *prototypes_ );
+    }
+    else
+    {
+      open_prototype_idx_.push_back( i );
+    }
+  }
+
+  if ( open_prototype_idx_.empty() )
+  {
+    autoComplete( mutableMsg().markers );
+    return;
+  }
+
+  // the others are completed by resolvePrototypes()
+  std::list<size_t>::const_iterator open_it = open_prototype_idx_.begin();
+  for ( size_t i=0; i<msg->markers.size(); i++ )
+  {
+    if ( open_it != open_prototype_idx_.end() && *open_it == i )
+    {
+      ++open_it;
+      continue;
+    }
+    autoComplete( mutableMsg().markers[i] );
+  }
+}
+
+template<class MsgT>
+void MessageContext<MsgT>::resolvePrototypes()
+{
+  std::list<size_t>::iterator idx_it;
+  for ( idx_it = open_prototype_idx_.begin(); idx_it != open_prototype_idx_.end(); )
+  {
+    if ( prototypes_ && prototypesKnown( msg->markers[ *idx_it ], *prototypes_ ) )
+    {
+      visualization_msgs::InteractiveMarker& im_msg = mutableMsg().markers[ *idx_it ];
+      expandPrototypes( im_msg, *prototypes_ );
+      autoComplete( im_msg );
+      idx_it = open_prototype_idx_.erase(idx_it);
+    }
+    else
+    {
+      DBG_MSG( "Prototypes of %s are not ready.", msg->markers[ *idx_it ].name.c_str() );
+      ++idx_it;
+    }
+  }
 }
 
 template<>
@@ -182,17 +290,14 @@ void MessageContext<visualization_msgs::InteractiveMarkerUpdate>::init()
   {
     open_pose_idx_.push_back( i );
   }
-  for( unsigned i=0; i<msg->markers.size(); i++ )
-  {
-    autoComplete( msg->markers[i] );
-  }
+  completeMarkers();
   for( unsigned i=0; i<msg->poses.size(); i++ )
   {
     // correct empty orientation
     if ( msg->poses[i].pose.orientation.w == 0 && msg->poses[i].pose.orientation.x == 0 &&
         msg->poses[i].pose.orientation.y == 0 && msg->poses[i].pose.orientation.z == 0 )
     {
-      msg->poses[i].pose.orientation.w = 1;
+      mutableMsg().poses[i].pose.orientation.w = 1;
     }
   }
 }
@@ -205,17 +310,25 @@ void MessageContext<visualization_msgs::InteractiveMarkerInit>::init()
   {
     open_marker_idx_.push_back( i );
   }
-  for( unsigned i=0; i<msg->markers.size(); i++ )
-  {
-    autoComplete( msg->markers[i] );
-  }
+  completeMarkers();
 }
 
 template<>
 void MessageContext<visualization_msgs::InteractiveMarkerUpdate>::getTfTransforms( )
 {
-  getTfTransforms( msg->markers, open_marker_idx_ );
-  getTfTransforms( msg->poses, open_pose_idx_ );
+  // the markers of prototypes may need transforms as well
+  resolvePrototypes();
+  if ( !open_prototype_idx_.empty() )
+  {
+    return;
+  }
+
+  // markers have been copied by autoComplete() already
+  if ( !open_marker_idx_.empty() )
+  {
+    getTfTransforms( mutableMsg().markers, open_marker_idx_ );
+  }
+  getPoseTfTransforms( open_pose_idx_ );
   if ( isReady() )
   {
     DBG_MSG( "Update message with seq_num=%lu is ready.", msg->seq_num );
@@ -225,7 +338,17 @@ void MessageContext<visualization_msgs::InteractiveMarkerUpdate>::getTfTransform
 template<>
 void MessageContext<visualization_msgs::InteractiveMarkerInit>::getTfTransforms( )
 {
-  getTfTransforms( msg->markers, open_marker_idx_ );
+  // the markers of prototypes may need transforms as well
+  resolvePrototypes();
+  if ( !open_prototype_idx_.empty() )
+  {
+    return;
+  }
+
+  if ( !open_marker_idx_.empty() )
+  {
+    getTfTransforms( mutableMsg().markers, open_marker_idx_ );
+  }
   if ( isReady() )
   {
     DBG_MSG( "Init message with seq_num=%lu is ready.", msg->seq_num );
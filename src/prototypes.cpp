@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "interactive_markers/detail/prototypes.h"
+
+namespace interactive_markers
+{
+
+namespace
+{
+
+const std::string PROTOTYPE_CONTROL_PREFIX = "__prototype__/";
+
+// @param[out] prototype  the name of the prototype a control refers to
+// @return false if the control is a regular one
+bool isReference( const visualization_msgs::InteractiveMarkerControl &control, std::string &prototype )
+{
+  if ( !control.markers.empty() ||
+       control.name.compare( 0, PROTOTYPE_CONTROL_PREFIX.size(), PROTOTYPE_CONTROL_PREFIX ) != 0 )
+  {
+    return false;
+  }
+  prototype = control.name.substr( PROTOTYPE_CONTROL_PREFIX.size() );
+  return true;
+}
+
+}
+
+std::string prototypeControlName( const std::string &prototype )
+{
+  return PROTOTYPE_CONTROL_PREFIX + prototype;
+}
+
+bool usesPrototypes( const visualization_msgs::InteractiveMarker &int_marker )
+{
+  std::string prototype;
+  for ( size_t c = 0; c < int_marker.controls.size(); c++ )
+  {
+    if ( isReference( int_marker.controls[c], prototype ) )
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool prototypesKnown( const visualization_msgs::InteractiveMarker &int_marker,
+    const M_Prototype &prototypes )
+{
+  std::string prototype;
+  for ( size_t c = 0; c < int_marker.controls.size(); c++ )
+  {
+    if ( isReference( int_marker.controls[c], prototype ) && prototypes.find( prototype ) == prototypes.end() )
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void expandPrototypes( visualization_msgs::InteractiveMarker &int_marker,
+    const M_Prototype &prototypes )
+{
+  std::vector<visualization_msgs::InteractiveMarkerControl> controls;
+  std::string prototype;
+  for ( size_t c = 0; c < int_marker.controls.size(); c++ )
+  {
+    if ( !isReference( int_marker.controls[c], prototype ) )
+    {
+      controls.push_back( int_marker.controls[c] );
+      continue;
+    }
+
+    M_Prototype::const_iterator it = prototypes.find( prototype );
+    if ( it != prototypes.end() )
+    {
+      controls.insert( controls.end(), it->second.begin(), it->second.end() );
+    }
+  }
+  int_marker.controls.swap( controls );
+}
+
+}
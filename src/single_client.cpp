@@ -44,14 +44,17 @@ SingleClient::SingleClient(
     const std::string& server_id,
     tf::Transformer& tf,
     const std::string& target_frame,
-    const InteractiveMarkerClient::CbCollection& callbacks
+    const InteractiveMarkerClient::CbCollection& callbacks,
+    const M_Prototype& prototypes
 )
 : state_(server_id,INIT)
 , first_update_seq_num_(-1)
 , last_update_seq_num_(-1)
+, last_pushed_seq_num_(-1)
 , tf_(tf)
 , target_frame_(target_frame)
 , callbacks_(callbacks)
+, prototypes_(prototypes)
 , server_id_(server_id)
 , warn_keepalive_(false)
 {
@@ -70,14 +73,25 @@ void SingleClient::process(const visualization_msgs::InteractiveMarkerInit::Cons
   switch (state_)
   {
   case INIT:
+  {
+    // the same state may arrive on both the plain and the compressed init topic
+    M_InitMessageContext::iterator it;
+    for ( it = init_queue_.begin(); it != init_queue_.end(); ++it )
+    {
+      if ( it->msg->seq_num == msg->seq_num )
+      {
+        return;
+      }
+    }
     if ( init_queue_.size() > 5 )
     {
       DBG_MSG( "Init queue too large. Erasing init message with id %lu.", init_queue_.begin()->msg->seq_num );
       init_queue_.pop_back();
     }
-    init_queue_.push_front( InitMessageContext(tf_,target_frame_,msg ) );
+    init_queue_.push_front( InitMessageContext(tf_,target_frame_,msg,&prototypes_ ) );
     callbacks_.statusCb( InteractiveMarkerClient::OK, server_id_, "Init message received." );
     break;
+  }
 
   case RECEIVING:
   case TF_ERROR:
@@ -128,11 +142,32 @@ void SingleClient::process(const visualization_msgs::InteractiveMarkerUpdate::Co
       DBG_MSG( "Update queue too large. Erasing update message with id %lu.", update_queue_.begin()->msg->seq_num );
       update_queue_.pop_back();
     }
-    update_queue_.push_front( UpdateMessageContext(tf_,target_frame_,msg) );
+    update_queue_.push_front( UpdateMessageContext(tf_,target_frame_,msg,&prototypes_) );
     break;
 
   case RECEIVING:
-    update_queue_.push_front( UpdateMessageContext(tf_,target_frame_,msg) );
+    update_queue_.push_front( UpdateMessageContext(tf_,target_frame_,msg,&prototypes_) );
+    break;
+
+  case TF_ERROR:
+    break;
+  }
+}
+
+void SingleClient::processPoses(const visualization_msgs::InteractiveMarkerUpdate::ConstPtr& msg)
+{
+  DBG_MSG( "%s: received poses #%lu", server_id_.c_str(), msg->seq_num );
+
+  switch (state_)
+  {
+  case INIT:
+  case RECEIVING:
+    if ( pose_queue_.size() > 100 )
+    {
+      DBG_MSG( "Pose queue too large. Erasing pose message with id %lu.", pose_queue_.back().msg->seq_num );
+      pose_queue_.pop_back();
+    }
+    pose_queue_.push_front( UpdateMessageContext(tf_,target_frame_,msg,&prototypes_) );
     break;
 
   case TF_ERROR:
@@ -152,7 +187,9 @@ void SingleClient::update()
 
   case RECEIVING:
     transformUpdateMsgs();
+    transformPoseMsgs();
     pushUpdates();
+    pushPoses();
     checkKeepAlive();
     if ( update_queue_.size() > 100 )
     {
@@ -224,6 +261,12 @@ void SingleClient::checkInitFinished()
       callbacks_.initCb( init_it->msg );
       callbacks_.statusCb( InteractiveMarkerClient::OK, server_id_, "Receiving updates." );
 
+      last_pushed_seq_num_ = init_seq_num;
+      for ( size_t i = 0; i < init_it->msg->markers.size(); i++ )
+      {
+        marker_seq_nums_[ init_it->msg->markers[i].name ] = init_seq_num;
+      }
+
       init_queue_.clear();
       state_ = RECEIVING;
 
@@ -279,14 +322,38 @@ void SingleClient::transformUpdateMsgs( )
   }
 }
 
+void SingleClient::transformPoseMsgs( )
+{
+  M_UpdateMessageContext::iterator it;
+  for ( it = pose_queue_.begin(); it!=pose_queue_.end(); ++it )
+  {
+    try
+    {
+      it->getTfTransforms();
+    }
+    catch ( std::runtime_error& e )
+    {
+      std::ostringstream s;
+      s << "Resetting due to tf error: " << e.what();
+      errorReset( s.str() );
+      return;
+    }
+  }
+}
+
 void SingleClient::errorReset( std::string error_msg )
 {
   // if we get an error here, we re-initialize everything
   state_ = TF_ERROR;
   update_queue_.clear();
   init_queue_.clear();
+  pose_queue_.clear();
   first_update_seq_num_ = -1;
   last_update_seq_num_ = -1;
+  last_pushed_seq_num_ = -1;
+  marker_seq_nums_.clear();
+  early_poses_.clear();
+  deferred_poses_.clear();
   warn_keepalive_ = false;
 
   callbacks_.statusCb( InteractiveMarkerClient::ERROR, server_id_, error_msg );
@@ -302,11 +369,131 @@ void SingleClient::pushUpdates()
   while( !update_queue_.empty() && update_queue_.back().isReady() )
   {
     DBG_MSG("Pushing out update #%lu.", update_queue_.back().msg->seq_num );
-    callbacks_.updateCb( update_queue_.back().msg );
+    visualization_msgs::InteractiveMarkerUpdateConstPtr msg = update_queue_.back().msg;
     update_queue_.pop_back();
+    callbacks_.updateCb( msg );
+    last_pushed_seq_num_ = msg->seq_num;
+    updateMarkerSeqNums( *msg );
   }
 }
 
+void SingleClient::updateMarkerSeqNums( const visualization_msgs::InteractiveMarkerUpdate& msg )
+{
+  uint64_t seq_num = msg.seq_num;
+  std::vector<visualization_msgs::InteractiveMarkerPose> poses;
+
+  // an older state has just replaced a pose that was passed on ahead of it
+  for ( size_t i = 0; i < msg.markers.size(); i++ )
+  {
+    marker_seq_nums_[ msg.markers[i].name ] = seq_num;
+    M_EarlyPose::iterator early_it = early_poses_.find( msg.markers[i].name );
+    if ( early_it != early_poses_.end() && early_it->second.seq_num > seq_num )
+    {
+      poses.push_back( early_it->second.pose );
+    }
+  }
+  for ( size_t i = 0; i < msg.poses.size(); i++ )
+  {
+    M_EarlyPose::iterator early_it = early_poses_.find( msg.poses[i].name );
+    if ( early_it != early_poses_.end() && early_it->second.seq_num > seq_num )
+    {
+      poses.push_back( early_it->second.pose );
+    }
+  }
+  for ( size_t i = 0; i < msg.erases.size(); i++ )
+  {
+    marker_seq_nums_.erase( msg.erases[i] );
+  }
+
+  // poses of markers that were unknown when they arrived
+  while ( !deferred_poses_.empty() && deferred_poses_.begin()->first <= seq_num )
+  {
+    std::vector<visualization_msgs::InteractiveMarkerPose>& deferred = deferred_poses_.begin()->second;
+    for ( size_t i = 0; i < deferred.size(); i++ )
+    {
+      M_SeqNum::iterator seq_it = marker_seq_nums_.find( deferred[i].name );
+      if ( seq_it != marker_seq_nums_.end() && seq_it->second < deferred_poses_.begin()->first )
+      {
+        poses.push_back( deferred[i] );
+      }
+    }
+    deferred_poses_.erase( deferred_poses_.begin() );
+  }
+
+  // the main channel has caught up with these
+  M_EarlyPose::iterator early_it;
+  for ( early_it = early_poses_.begin(); early_it != early_poses_.end(); )
+  {
+    if ( early_it->second.seq_num <= seq_num )
+    {
+      early_it = early_poses_.erase( early_it );
+    }
+    else
+    {
+      ++early_it;
+    }
+  }
+
+  if ( !poses.empty() )
+  {
+    pushPoseUpdate( seq_num, poses );
+  }
+}
+
+void SingleClient::pushPoses()
+{
+  while( !pose_queue_.empty() && pose_queue_.back().isReady() )
+  {
+    visualization_msgs::InteractiveMarkerUpdateConstPtr msg = pose_queue_.back().msg;
+    pose_queue_.pop_back();
+
+    uint64_t seq_num = msg->seq_num;
+    bool ahead = seq_num > last_pushed_seq_num_;
+    std::vector<visualization_msgs::InteractiveMarkerPose> poses;
+
+    for ( size_t i = 0; i < msg->poses.size(); i++ )
+    {
+      const visualization_msgs::InteractiveMarkerPose& pose = msg->poses[i];
+      M_SeqNum::iterator seq_it = marker_seq_nums_.find( pose.name );
+      if ( seq_it == marker_seq_nums_.end() )
+      {
+        // the marker itself is still on its way
+        if ( ahead )
+        {
+          deferred_poses_[seq_num].push_back( pose );
+        }
+      }
+      else if ( seq_it->second < seq_num )
+      {
+        // otherwise a newer definition of the marker has been passed on already
+        poses.push_back( pose );
+        if ( ahead )
+        {
+          EarlyPose& early_pose = early_poses_[pose.name];
+          early_pose.seq_num = seq_num;
+          early_pose.pose = pose;
+        }
+      }
+    }
+
+    if ( !poses.empty() )
+    {
+      DBG_MSG("Pushing out poses #%lu.", seq_num );
+      pushPoseUpdate( seq_num, poses );
+    }
+  }
+}
+
+void SingleClient::pushPoseUpdate( uint64_t seq_num, std::vector<visualization_msgs::InteractiveMarkerPose>& poses )
+{
+  visualization_msgs::InteractiveMarkerUpdatePtr msg( new visualization_msgs::InteractiveMarkerUpdate() );
+  msg->server_id = server_id_;
+  msg->seq_num = seq_num;
+  msg->type = visualization_msgs::InteractiveMarkerUpdate::UPDATE;
+  msg->poses.swap( poses );
+  callbacks_.updateCb( msg );
+}
+
 bool SingleClient::isInitialized()
 {
   return (state_ != INIT);
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "interactive_markers/detail/spatial_grid.h"
+
+#include <boost/functional/hash.hpp>
+
+#include <cmath>
+
+namespace interactive_markers
+{
+
+bool SpatialGrid::Cell::operator==( const Cell &other ) const
+{
+  return x == other.x && y == other.y && z == other.z && frame_id == other.frame_id;
+}
+
+size_t hash_value( const SpatialGrid::Cell &cell )
+{
+  size_t seed = boost::hash<std::string>()( cell.frame_id );
+  boost::hash_combine( seed, cell.x );
+  boost::hash_combine( seed, cell.y );
+  boost::hash_combine( seed, cell.z );
+  return seed;
+}
+
+SpatialGrid::SpatialGrid( double cell_size ) :
+    cell_size_( cell_size )
+{
+}
+
+SpatialGrid::Cell SpatialGrid::cellFor( const std::string &frame_id, const geometry_msgs::Point &position ) const
+{
+  Cell cell;
+  cell.frame_id = frame_id;
+  cell.x = (int64_t)std::floor( position.x / cell_size_ );
+  cell.y = (int64_t)std::floor( position.y / cell_size_ );
+  cell.z = (int64_t)std::floor( position.z / cell_size_ );
+  return cell;
+}
+
+void SpatialGrid::insert( const std::string &name, const std::string &frame_id, const geometry_msgs::Point &position )
+{
+  Cell cell = cellFor( frame_id, position );
+
+  boost::unordered_map< std::string, Entry >::iterator entry_it = entries_.find( name );
+  if ( entry_it != entries_.end() )
+  {
+    if ( entry_it->second.cell == cell )
+    {
+      entry_it->second.position = position;
+      return;
+    }
+    // moved to another cell
+    erase( name );
+  }
+
+  Entry entry;
+  entry.position = position;
+  entry.cell = cell;
+  entries_.insert( std::make_pair( name, entry ) );
+  cells_[cell].insert( name );
+}
+
+bool SpatialGrid::erase( const std::string &name )
+{
+  boost::unordered_map< std::string, Entry >::iterator entry_it = entries_.find( name );
+  if ( entry_it == entries_.end() )
+  {
+    return false;
+  }
+
+  boost::unordered_map< Cell, boost::unordered_set<std::string> >::iterator cell_it = cells_.find( entry_it->second.cell );
+  cell_it->second.erase( name );
+  if ( cell_it->second.empty() )
+  {
+    cells_.erase( cell_it );
+  }
+  entries_.erase( entry_it );
+  return true;
+}
+
+void SpatialGrid::clear()
+{
+  entries_.clear();
+  cells_.clear();
+}
+
+size_t SpatialGrid::size() const
+{
+  return entries_.size();
+}
+
+void SpatialGrid::findInBox( const std::string &frame_id,
+    const geometry_msgs::Point &min,
+    const geometry_msgs::Point &max,
+    std::vector<std::string> &names ) const
+{
+  find( frame_id, min, max, 0, 0.0, names );
+}
+
+void SpatialGrid::findInRadius( const std::string &frame_id,
+    const geometry_msgs::Point &center,
+    double radius,
+    std::vector<std::string> &names ) const
+{
+  geometry_msgs::Point min, max;
+  min.x = center.x - radius;
+  min.y = center.y - radius;
+  min.z = center.z - radius;
+  max.x = center.x + radius;
+  max.y = center.y + radius;
+  max.z = center.z + radius;
+  find( frame_id, min, max, &center, radius, names );
+}
+
+void SpatialGrid::find( const std::string &frame_id,
+    const geometry_msgs::Point &min,
+    const geometry_msgs::Point &max,
+    const geometry_msgs::Point *center,
+    double radius,
+    std::vector<std::string> &names ) const
+{
+  if ( min.x > max.x || min.y > max.y || min.z > max.z )
+  {
+    return;
+  }
+
+  Cell min_cell = cellFor( frame_id, min );
+  Cell max_cell = cellFor( frame_id, max );
+
+  // checking every entry is cheaper than visiting a lot of empty cells
+  double num_cells = double( max_cell.x - min_cell.x + 1 ) *
+      double( max_cell.y - min_cell.y + 1 ) * double( max_cell.z - min_cell.z + 1 );
+  bool scan_entries = num_cells > entries_.size();
+
+  std::vector<const std::string*> candidates;
+  if ( scan_entries )
+  {
+    boost::unordered_map< std::string, Entry >::const_iterator it;
+    for ( it = entries_.begin(); it != entries_.end(); it++ )
+    {
+      if ( it->second.cell.frame_id == frame_id )
+      {
+        candidates.push_back( &it->first );
+      }
+    }
+  }
+  else
+  {
+    Cell cell = min_cell;
+    for ( cell.x = min_cell.x; cell.x <= max_cell.x; cell.x++ )
+    {
+      for ( cell.y = min_cell.y; cell.y <= max_cell.y; cell.y++ )
+      {
+        for ( cell.z = min_cell.z; cell.z <= max_cell.z; cell.z++ )
+        {
+          boost::unordered_map< Cell, boost::unordered_set<std::string> >::const_iterator cell_it = cells_.find( cell );
+          if ( cell_it == cells_.end() )
+          {
+            continue;
+          }
+          boost::unordered_set<std::string>::const_iterator name_it;
+          for ( name_it = cell_it->second.begin(); name_it != cell_it->second.end(); name_it++ )
+          {
+            candidates.push_back( &*name_it );
+          }
+        }
+      }
+    }
+  }
+
+  // cells at the border are only partly inside
+  for ( size_t i = 0; i < candidates.size(); i++ )
+  {
+    const geometry_msgs::Point &p = entries_.find( *candidates[i] )->second.position;
+    if ( p.x < min.x || p.x > max.x || p.y < min.y || p.y > max.y || p.z < min.z || p.z > max.z )
+    {
+      continue;
+    }
+    if ( center )
+    {
+      double dx = p.x - center->x;
+      double dy = p.y - center->y;
+      double dz = p.z - center->z;
+      if ( dx*dx + dy*dy + dz*dz > radius*radius )
+      {
+        continue;
+      }
+    }
+    names.push_back( *candidates[i] );
+  }
+}
+
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Measures how autoComplete() on a vector of interactive markers
+// scales with the number of markers and worker threads.
+
+#include <ros/ros.h>
+
+#include <interactive_markers/tools.h>
+
+#include <boost/thread/thread.hpp>
+
+#include <stdio.h>
+
+using namespace visualization_msgs;
+
+InteractiveMarker make6DofMarker( unsigned i )
+{
+  InteractiveMarker int_marker;
+  std::ostringstream s;
+  s << "marker_" << i;
+  int_marker.name = s.str();
+  int_marker.header.frame_id = "/base_link";
+
+  InteractiveMarkerControl control;
+
+  const char* axes[] = { "x", "y", "z" };
+  for ( unsigned a=0; a<3; a++ )
+  {
+    control.orientation.w = 1;
+    control.orientation.x = a==0;
+    control.orientation.y = a==1;
+    control.orientation.z = a==2;
+    control.name = std::string("rotate_") + axes[a];
+    control.interaction_mode = InteractiveMarkerControl::ROTATE_AXIS;
+    int_marker.controls.push_back(control);
+    control.name = std::string("move_") + axes[a];
+    control.interaction_mode = InteractiveMarkerControl::MOVE_AXIS;
+    int_marker.controls.push_back(control);
+  }
+
+  return int_marker;
+}
+
+// compare two completed batches, ignoring the offset of the marker ids
+bool equalResults( const std::vector<InteractiveMarker>& a, const std::vector<InteractiveMarker>& b )
+{
+  if ( a.size() != b.size() )
+  {
+    return false;
+  }
+  int32_t id_offset_a = 0, id_offset_b = 0;
+  bool first = true;
+  for ( size_t i=0; i<a.size(); i++ )
+  {
+    if ( a[i].controls.size() != b[i].controls.size() )
+    {
+      return false;
+    }
+    for ( size_t c=0; c<a[i].controls.size(); c++ )
+    {
+      const InteractiveMarkerControl& ca = a[i].controls[c];
+      const InteractiveMarkerControl& cb = b[i].controls[c];
+      if ( ca.name != cb.name || ca.markers.size() != cb.markers.size() )
+      {
+        return false;
+      }
+      for ( size_t m=0; m<ca.markers.size(); m++ )
+      {
+        if ( first )
+        {
+          id_offset_a = ca.markers[m].id;
+          id_offset_b = cb.markers[m].id;
+          first = false;
+        }
+        if ( ca.markers[m].id - id_offset_a != cb.markers[m].id - id_offset_b ||
+             ca.markers[m].points.size() != cb.markers[m].points.size() ||
+             ca.markers[m].ns != cb.markers[m].ns )
+        {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  const unsigned marker_counts[] = { 1000, 5000, 10000, 50000 };
+  const unsigned num_marker_counts = sizeof(marker_counts) / sizeof(marker_counts[0]);
+
+  std::vector<unsigned> thread_counts;
+  for ( unsigned t=1; t<=boost::thread::hardware_concurrency(); t*=2 )
+  {
+    thread_counts.push_back( t );
+  }
+
+  printf( "%8s %8s %12s %10s %s\n", "markers", "threads", "time [ms]", "speedup", "deterministic" );
+
+  for ( unsigned n=0; n<num_marker_counts; n++ )
+  {
+    std::vector<InteractiveMarker> input;
+    input.reserve( marker_counts[n] );
+    for ( unsigned i=0; i<marker_counts[n]; i++ )
+    {
+      input.push_back( make6DofMarker(i) );
+    }
+
+    std::vector<InteractiveMarker> reference;
+    double serial_time = 0;
+
+    for ( unsigned t=0; t<thread_counts.size(); t++ )
+    {
+      std::vector<InteractiveMarker> msgs = input;
+
+      interactive_markers::AutoCompleteOptions options;
+      options.num_threads = thread_counts[t];
+
+      ros::WallTime start = ros::WallTime::now();
+      interactive_markers::autoComplete( msgs, options );
+      double time = (ros::WallTime::now() - start).toSec();
+
+      if ( t == 0 )
+      {
+        reference.swap( msgs );
+        serial_time = time;
+      }
+
+      printf( "%8u %8u %12.2f %10.2f %s\n", marker_counts[n], thread_counts[t], time * 1000.0,
+          serial_time / time, t == 0 || equalResults( reference, msgs ) ? "yes" : "NO" );
+    }
+  }
+
+  return 0;
+}
@@ -37,6 +37,10 @@
 
 #include <interactive_markers/interactive_marker_server.h>
 #include <interactive_markers/interactive_marker_client.h>
+#include <interactive_markers/tools.h>
+#include <interactive_markers/detail/message_context.h>
+#include <interactive_markers/detail/compact_poses.h>
+#include <interactive_markers/detail/compressed_init.h>
 
 #define DBG_MSG( ... ) printf( __VA_ARGS__ ); printf("\n");
 #define DBG_MSG_STREAM( ... )  std::cout << __VA_ARGS__ << std::endl;
@@ -912,6 +916,391 @@ TEST(InteractiveMarkerClient, init_twoservers)
   t.test(seq);
 }
 
+void expectSamePose( const geometry_msgs::Pose &a, const geometry_msgs::Pose &b )
+{
+  EXPECT_EQ( a.position.x, b.position.x );
+  EXPECT_EQ( a.position.y, b.position.y );
+  EXPECT_EQ( a.position.z, b.position.z );
+  EXPECT_EQ( a.orientation.x, b.orientation.x );
+  EXPECT_EQ( a.orientation.y, b.orientation.y );
+  EXPECT_EQ( a.orientation.z, b.orientation.z );
+  EXPECT_EQ( a.orientation.w, b.orientation.w );
+}
+
+TEST(InteractiveMarkerClient, batch_autocomplete)
+{
+  std::vector<visualization_msgs::InteractiveMarker> markers( 1000 );
+  for ( size_t i=0; i<markers.size(); i++ )
+  {
+    std::stringstream ss;
+    ss << "marker" << i;
+    markers[i].name = ss.str();
+    markers[i].pose.orientation.z = i % 3;
+    visualization_msgs::InteractiveMarkerControl control;
+    control.name = "control";
+    control.interaction_mode = visualization_msgs::InteractiveMarkerControl::MOVE_AXIS;
+    markers[i].controls.resize( i % 4, control );
+  }
+
+  std::vector<visualization_msgs::InteractiveMarker> serial = markers;
+  AutoCompleteOptions serial_options;
+  serial_options.num_threads = 1;
+  autoComplete( serial, serial_options );
+
+  // run twice, the second time on workers that are already running
+  for ( int run=0; run<2; run++ )
+  {
+    std::vector<visualization_msgs::InteractiveMarker> parallel = markers;
+    AutoCompleteOptions parallel_options;
+    parallel_options.num_threads = 4;
+    parallel_options.min_batch_size = 1;
+    autoComplete( parallel, parallel_options );
+
+    // marker ids are unique across calls, so they only match relative to the first one
+    int serial_id = serial[1].controls[0].markers[0].id;
+    int parallel_id = parallel[1].controls[0].markers[0].id;
+    for ( size_t i=0; i<serial.size(); i++ )
+    {
+      ASSERT_EQ( serial[i].scale, parallel[i].scale );
+      expectSamePose( serial[i].pose, parallel[i].pose );
+      ASSERT_EQ( serial[i].controls.size(), parallel[i].controls.size() );
+      for ( size_t c=0; c<serial[i].controls.size(); c++ )
+      {
+        const visualization_msgs::InteractiveMarkerControl &serial_control = serial[i].controls[c];
+        const visualization_msgs::InteractiveMarkerControl &parallel_control = parallel[i].controls[c];
+        ASSERT_EQ( serial_control.name, parallel_control.name );
+        ASSERT_EQ( serial_control.markers.size(), parallel_control.markers.size() );
+        for ( size_t m=0; m<serial_control.markers.size(); m++ )
+        {
+          const visualization_msgs::Marker &serial_marker = serial_control.markers[m];
+          const visualization_msgs::Marker &parallel_marker = parallel_control.markers[m];
+          ASSERT_EQ( serial_marker.id - serial_id, parallel_marker.id - parallel_id );
+          ASSERT_EQ( serial_marker.type, parallel_marker.type );
+          ASSERT_EQ( serial_marker.scale.x, parallel_marker.scale.x );
+          ASSERT_EQ( serial_marker.color.r, parallel_marker.color.r );
+          expectSamePose( serial_marker.pose, parallel_marker.pose );
+        }
+      }
+    }
+  }
+}
+
+TEST(InteractiveMarkerClient, message_context_no_copy)
+{
+  tf::Transformer tf;
+
+  // a pose update which needs no changes is used as received
+  visualization_msgs::InteractiveMarkerUpdatePtr update( new visualization_msgs::InteractiveMarkerUpdate() );
+  update->type = visualization_msgs::InteractiveMarkerUpdate::UPDATE;
+  update->poses.resize( 1 );
+  update->poses[0].name = "marker1";
+  update->poses[0].header.frame_id = target_frame;
+  update->poses[0].pose.orientation.w = 1;
+
+  MessageContext<visualization_msgs::InteractiveMarkerUpdate> update_context( tf, target_frame, update );
+  update_context.getTfTransforms();
+  ASSERT_TRUE( update_context.isReady() );
+  ASSERT_EQ( update.get(), update_context.msg.get() );
+
+  // an empty orientation needs to be corrected in a private copy
+  visualization_msgs::InteractiveMarkerUpdatePtr update2( new visualization_msgs::InteractiveMarkerUpdate( *update ) );
+  update2->poses[0].pose.orientation.w = 0;
+
+  MessageContext<visualization_msgs::InteractiveMarkerUpdate> update_context2( tf, target_frame, update2 );
+  update_context2.getTfTransforms();
+  ASSERT_NE( update2.get(), update_context2.msg.get() );
+  ASSERT_EQ( 1, update_context2.msg->poses[0].pose.orientation.w );
+  ASSERT_EQ( 0, update2->poses[0].pose.orientation.w );
+
+  // assignment takes the message along with the indices into it
+  update_context = update_context2;
+  ASSERT_EQ( update_context2.msg.get(), update_context.msg.get() );
+  ASSERT_TRUE( update_context.isReady() );
+}
+
+TEST(InteractiveMarkerClient, message_context_copy_on_write)
+{
+  tf::Transformer tf;
+
+  // the empty orientation makes the context copy the message right away,
+  // the pose in another frame is only changed once its transform arrives
+  visualization_msgs::InteractiveMarkerUpdatePtr update( new visualization_msgs::InteractiveMarkerUpdate() );
+  update->type = visualization_msgs::InteractiveMarkerUpdate::UPDATE;
+  update->poses.resize( 1 );
+  update->poses[0].name = "marker1";
+  update->poses[0].header.frame_id = "other_frame";
+  update->poses[0].header.stamp = ros::Time( 1 );
+
+  MessageContext<visualization_msgs::InteractiveMarkerUpdate> context( tf, target_frame, update );
+  ASSERT_NE( update.get(), context.msg.get() );
+
+  MessageContext<visualization_msgs::InteractiveMarkerUpdate> copy( context );
+  MessageContext<visualization_msgs::InteractiveMarkerUpdate> assigned( context );
+  assigned = context;
+  ASSERT_EQ( context.msg.get(), copy.msg.get() );
+  ASSERT_EQ( context.msg.get(), assigned.msg.get() );
+
+  tf::StampedTransform stf;
+  stf.setIdentity();
+  stf.frame_id_ = "other_frame";
+  stf.child_frame_id_ = target_frame;
+  stf.stamp_ = ros::Time( 1 );
+  tf.setTransform( stf );
+
+  // changing the copies leaves the original alone
+  copy.getTfTransforms();
+  assigned.getTfTransforms();
+  ASSERT_TRUE( copy.isReady() );
+  ASSERT_TRUE( assigned.isReady() );
+  ASSERT_EQ( target_frame, copy.msg->poses[0].header.frame_id );
+  ASSERT_EQ( target_frame, assigned.msg->poses[0].header.frame_id );
+  ASSERT_NE( copy.msg.get(), assigned.msg.get() );
+  ASSERT_EQ( "other_frame", context.msg->poses[0].header.frame_id );
+  ASSERT_FALSE( context.isReady() );
+
+  context.getTfTransforms();
+  ASSERT_TRUE( context.isReady() );
+  ASSERT_EQ( target_frame, context.msg->poses[0].header.frame_id );
+}
+
+// records the updates passed on by a client
+struct UpdateRecorder
+{
+  void updateCb( const visualization_msgs::InteractiveMarkerUpdateConstPtr& msg )
+  {
+    updates.push_back( msg );
+  }
+
+  std::vector<visualization_msgs::InteractiveMarkerUpdateConstPtr> updates;
+};
+
+visualization_msgs::InteractiveMarkerUpdatePtr makeUpdate( uint64_t seq_num )
+{
+  visualization_msgs::InteractiveMarkerUpdatePtr update( new visualization_msgs::InteractiveMarkerUpdate() );
+  update->server_id = "server1";
+  update->type = visualization_msgs::InteractiveMarkerUpdate::UPDATE;
+  update->seq_num = seq_num;
+  return update;
+}
+
+visualization_msgs::InteractiveMarkerPose makePose( const std::string& name, double x )
+{
+  visualization_msgs::InteractiveMarkerPose pose;
+  pose.name = name;
+  pose.header.frame_id = target_frame;
+  pose.pose.position.x = x;
+  pose.pose.orientation.w = 1;
+  return pose;
+}
+
+TEST(InteractiveMarkerClient, separate_pose_topic)
+{
+  tf::Transformer tf;
+  interactive_markers::InteractiveMarkerClient client( tf, target_frame, "im_client_test_poses" );
+  UpdateRecorder recorder;
+  client.setUpdateCb( boost::bind( &UpdateRecorder::updateCb, &recorder, _1 ) );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "a";
+  int_marker.header.frame_id = target_frame;
+  int_marker.pose.orientation.w = 1;
+
+  visualization_msgs::InteractiveMarkerInitPtr init( new visualization_msgs::InteractiveMarkerInit() );
+  init->server_id = "server1";
+  init->markers.push_back( int_marker );
+  client.processInit( init );
+  visualization_msgs::InteractiveMarkerUpdatePtr keep_alive = makeUpdate( 0 );
+  keep_alive->type = visualization_msgs::InteractiveMarkerUpdate::KEEP_ALIVE;
+  client.processUpdate( keep_alive );
+  client.update();
+
+  // the pose of a known marker is passed on before the update
+  // that re-inserts the marker has arrived
+  visualization_msgs::InteractiveMarkerUpdatePtr poses2 = makeUpdate( 2 );
+  poses2->poses.push_back( makePose( "a", 2.0 ) );
+  client.processPoseUpdate( poses2 );
+  client.update();
+  ASSERT_EQ( 1u, recorder.updates.size() );
+  ASSERT_EQ( 2.0, recorder.updates[0]->poses[0].pose.position.x );
+
+  // the older marker is followed by the newer pose again
+  visualization_msgs::InteractiveMarkerUpdatePtr update1 = makeUpdate( 1 );
+  int_marker.pose.position.x = 1.0;
+  update1->markers.push_back( int_marker );
+  client.processUpdate( update1 );
+  client.update();
+  ASSERT_EQ( 3u, recorder.updates.size() );
+  ASSERT_EQ( 1.0, recorder.updates[1]->markers[0].pose.position.x );
+  ASSERT_EQ( 2.0, recorder.updates[2]->poses[0].pose.position.x );
+
+  client.processUpdate( makeUpdate( 2 ) );
+  client.update();
+  ASSERT_EQ( 4u, recorder.updates.size() );
+
+  // the pose of a marker that has not arrived yet waits for its update
+  visualization_msgs::InteractiveMarkerUpdatePtr poses4 = makeUpdate( 4 );
+  poses4->poses.push_back( makePose( "b", 4.0 ) );
+  client.processPoseUpdate( poses4 );
+  client.update();
+  ASSERT_EQ( 4u, recorder.updates.size() );
+
+  visualization_msgs::InteractiveMarkerUpdatePtr update3 = makeUpdate( 3 );
+  int_marker.name = "b";
+  update3->markers.push_back( int_marker );
+  client.processUpdate( update3 );
+  client.processUpdate( makeUpdate( 4 ) );
+  client.update();
+  ASSERT_EQ( 7u, recorder.updates.size() );
+  ASSERT_EQ( 3u, recorder.updates[4]->seq_num );
+  ASSERT_EQ( 4u, recorder.updates[5]->seq_num );
+  ASSERT_EQ( 4.0, recorder.updates[6]->poses[0].pose.position.x );
+
+  // poses older than the last definition of a marker are dropped
+  visualization_msgs::InteractiveMarkerUpdatePtr poses3 = makeUpdate( 3 );
+  poses3->poses.push_back( makePose( "b", 3.0 ) );
+  client.processPoseUpdate( poses3 );
+  client.update();
+  ASSERT_EQ( 7u, recorder.updates.size() );
+}
+
+// records the init messages passed on by a client
+struct InitRecorder
+{
+  void initCb( const visualization_msgs::InteractiveMarkerInitConstPtr& msg )
+  {
+    inits.push_back( msg );
+  }
+
+  std::vector<visualization_msgs::InteractiveMarkerInitConstPtr> inits;
+};
+
+TEST(InteractiveMarkerClient, compressed_init)
+{
+  tf::Transformer tf;
+  interactive_markers::InteractiveMarkerClient client( tf, target_frame, "im_client_test_compressed" );
+  InitRecorder recorder;
+  client.setInitCb( boost::bind( &InitRecorder::initCb, &recorder, _1 ) );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "a";
+  int_marker.header.frame_id = target_frame;
+  int_marker.pose.orientation.w = 1;
+
+  visualization_msgs::InteractiveMarkerInit init;
+  init.server_id = "server1";
+  init.seq_num = 1;
+  init.markers.push_back( int_marker );
+
+  std_msgs::UInt8MultiArrayPtr compressed( new std_msgs::UInt8MultiArray() );
+  ASSERT_TRUE( compressInit( init, compressed->data, 1 ) );
+
+  // a truncated message is rejected
+  std_msgs::UInt8MultiArrayPtr truncated( new std_msgs::UInt8MultiArray( *compressed ) );
+  truncated->data.resize( truncated->data.size() / 2 );
+  client.processCompressedInit( truncated );
+
+  client.processCompressedInit( compressed );
+  client.processUpdate( makeUpdate( 1 ) );
+  client.update();
+
+  ASSERT_EQ( 1u, recorder.inits.size() );
+  ASSERT_EQ( "server1", recorder.inits[0]->server_id );
+  ASSERT_EQ( 1u, recorder.inits[0]->seq_num );
+  ASSERT_EQ( 1u, recorder.inits[0]->markers.size() );
+  ASSERT_EQ( "a", recorder.inits[0]->markers[0].name );
+}
+
+TEST(InteractiveMarkerClient, compact_poses)
+{
+  tf::Transformer tf;
+  interactive_markers::InteractiveMarkerClient client( tf, target_frame, "im_client_test_compact" );
+  UpdateRecorder recorder;
+  client.setUpdateCb( boost::bind( &UpdateRecorder::updateCb, &recorder, _1 ) );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "a";
+  int_marker.header.frame_id = target_frame;
+  int_marker.pose.orientation.w = 1;
+
+  visualization_msgs::InteractiveMarkerInitPtr init( new visualization_msgs::InteractiveMarkerInit() );
+  init->server_id = "server1";
+  init->markers.push_back( int_marker );
+  client.processInit( init );
+  visualization_msgs::InteractiveMarkerUpdatePtr keep_alive = makeUpdate( 0 );
+  keep_alive->type = visualization_msgs::InteractiveMarkerUpdate::KEEP_ALIVE;
+  client.processUpdate( keep_alive );
+  client.update();
+
+  visualization_msgs::InteractiveMarkerUpdatePtr poses1 = makeUpdate( 1 );
+  poses1->poses.push_back( makePose( "a", 1.0 ) );
+  std_msgs::UInt8MultiArrayPtr compact( new std_msgs::UInt8MultiArray() );
+  encodeCompactPoses( *poses1, 0.01, compact->data );
+
+  // a truncated message is rejected
+  std_msgs::UInt8MultiArrayPtr truncated( new std_msgs::UInt8MultiArray( *compact ) );
+  truncated->data.resize( truncated->data.size() - 1 );
+  client.processCompactPoseUpdate( truncated );
+  client.update();
+  ASSERT_EQ( 0u, recorder.updates.size() );
+
+  // the expanded poses are passed on like those of the separate pose topic
+  client.processCompactPoseUpdate( compact );
+  client.update();
+  ASSERT_EQ( 1u, recorder.updates.size() );
+  ASSERT_EQ( "server1", recorder.updates[0]->server_id );
+  ASSERT_EQ( 1u, recorder.updates[0]->poses.size() );
+  ASSERT_EQ( "a", recorder.updates[0]->poses[0].name );
+  ASSERT_EQ( target_frame, recorder.updates[0]->poses[0].header.frame_id );
+  ASSERT_NEAR( 1.0, recorder.updates[0]->poses[0].pose.position.x, 1e-9 );
+  ASSERT_NEAR( 1.0, recorder.updates[0]->poses[0].pose.orientation.w, 1e-9 );
+}
+
+TEST(InteractiveMarkerClient, prototypes)
+{
+  tf::Transformer tf;
+  interactive_markers::InteractiveMarkerClient client( tf, target_frame, "im_client_test_prototypes" );
+  InitRecorder recorder;
+  client.setInitCb( boost::bind( &InitRecorder::initCb, &recorder, _1 ) );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "a";
+  int_marker.header.frame_id = target_frame;
+  interactive_markers::usePrototype( int_marker, "arm" );
+
+  visualization_msgs::InteractiveMarkerInitPtr init( new visualization_msgs::InteractiveMarkerInit() );
+  init->server_id = "server1";
+  init->markers.push_back( int_marker );
+  client.processInit( init );
+  client.processUpdate( makeUpdate( 0 ) );
+  client.update();
+
+  // the init message waits for the prototype
+  ASSERT_EQ( 0u, recorder.inits.size() );
+
+  visualization_msgs::InteractiveMarker prototype;
+  prototype.name = "arm";
+  prototype.controls.resize( 2 );
+  prototype.controls[0].name = "handle";
+  prototype.controls[0].markers.push_back( visualization_msgs::Marker() );
+  prototype.controls[1].name = "ring";
+  prototype.controls[1].interaction_mode = visualization_msgs::InteractiveMarkerControl::ROTATE_AXIS;
+  visualization_msgs::InteractiveMarkerInitPtr prototypes( new visualization_msgs::InteractiveMarkerInit() );
+  prototypes->server_id = "server1";
+  prototypes->markers.push_back( prototype );
+  client.processPrototypes( prototypes );
+  client.update();
+
+  ASSERT_EQ( 1u, recorder.inits.size() );
+  const visualization_msgs::InteractiveMarker& expanded = recorder.inits[0]->markers[0];
+  ASSERT_EQ( 2u, expanded.controls.size() );
+  ASSERT_EQ( "handle", expanded.controls[0].name );
+  ASSERT_EQ( 1u, expanded.controls[0].markers.size() );
+  // the expanded marker has been completed
+  ASSERT_EQ( "ring", expanded.controls[1].name );
+  ASSERT_FALSE( expanded.controls[1].markers.empty() );
+  ASSERT_EQ( 1, expanded.pose.orientation.w );
+}
+
 
 // Run all the tests that were declared with TEST()
 int main(int argc, char **argv)
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Compares the plain and the compressed init topic for a set of mesh markers:
+// the message size, the time the server needs to compress the state and
+// the time a client needs to decode it, for several zlib levels.
+// The transfer time assumes a 10 Mbit/s link.
+//
+// Usage: compressed_init_benchmark [num_markers] [grid_size]
+//
+// Each marker is a TRIANGLE_LIST of a wavy grid_size x grid_size surface,
+// which repeats every vertex in up to six triangles like exported meshes do.
+
+#include <ros/ros.h>
+
+#include <interactive_markers/detail/compressed_init.h>
+
+#include <visualization_msgs/InteractiveMarkerInit.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace visualization_msgs;
+
+const unsigned num_runs = 5;
+
+// for the transfer time column, a slow Wi-Fi link
+const double link_bytes_per_sec = 10e6 / 8;
+
+geometry_msgs::Point gridPoint( unsigned i, unsigned j, unsigned grid_size )
+{
+  geometry_msgs::Point point;
+  point.x = double(i) / grid_size;
+  point.y = double(j) / grid_size;
+  point.z = 0.05 * sin( 10.0 * point.x ) * cos( 7.0 * point.y );
+  return point;
+}
+
+InteractiveMarker makeMarker( unsigned n, unsigned grid_size )
+{
+  std::ostringstream s;
+  s << "mesh_" << n;
+
+  InteractiveMarker int_marker;
+  int_marker.name = s.str();
+  int_marker.header.frame_id = "/base_link";
+  int_marker.pose.position.x = n;
+  int_marker.pose.orientation.w = 1;
+
+  Marker marker;
+  marker.type = Marker::TRIANGLE_LIST;
+  marker.scale.x = marker.scale.y = marker.scale.z = 1;
+  marker.color.r = marker.color.a = 1;
+  marker.points.reserve( grid_size * grid_size * 6 );
+  for ( unsigned i = 0; i < grid_size; i++ )
+  {
+    for ( unsigned j = 0; j < grid_size; j++ )
+    {
+      marker.points.push_back( gridPoint( i, j, grid_size ) );
+      marker.points.push_back( gridPoint( i + 1, j, grid_size ) );
+      marker.points.push_back( gridPoint( i, j + 1, grid_size ) );
+      marker.points.push_back( gridPoint( i + 1, j, grid_size ) );
+      marker.points.push_back( gridPoint( i + 1, j + 1, grid_size ) );
+      marker.points.push_back( gridPoint( i, j + 1, grid_size ) );
+    }
+  }
+
+  InteractiveMarkerControl control;
+  control.always_visible = true;
+  control.interaction_mode = InteractiveMarkerControl::MOVE_PLANE;
+  control.markers.push_back( marker );
+  int_marker.controls.push_back( control );
+  return int_marker;
+}
+
+double plainDecodeTime( const InteractiveMarkerInit &init )
+{
+  uint32_t length = ros::serialization::serializationLength( init );
+  std::vector<uint8_t> buffer( length );
+  ros::serialization::OStream out( &buffer[0], length );
+  ros::serialization::serialize( out, init );
+
+  ros::WallTime start = ros::WallTime::now();
+  for ( unsigned run = 0; run < num_runs; run++ )
+  {
+    InteractiveMarkerInit decoded;
+    ros::serialization::IStream in( &buffer[0], length );
+    ros::serialization::deserialize( in, decoded );
+  }
+  return ( ros::WallTime::now() - start ).toSec() / num_runs;
+}
+
+int main(int argc, char** argv)
+{
+  unsigned num_markers = argc > 1 ? atoi( argv[1] ) : 20;
+  unsigned grid_size = argc > 2 ? atoi( argv[2] ) : 100;
+
+  InteractiveMarkerInit init;
+  init.server_id = "/compressed_init_benchmark";
+  init.seq_num = 1;
+  for ( unsigned n = 0; n < num_markers; n++ )
+  {
+    init.markers.push_back( makeMarker( n, grid_size ) );
+  }
+
+  uint32_t plain_size = ros::serialization::serializationLength( init );
+  printf( "%u markers, %u triangles each\n", num_markers, grid_size * grid_size * 2 );
+  printf( "%8s %14s %10s %16s %16s %14s\n", "level", "size [bytes]", "ratio", "compress [ms]", "decode [ms]", "transfer [s]" );
+  printf( "%8s %14u %10.2f %16s %16.2f %14.2f\n", "plain", plain_size, 1.0, "-",
+      plainDecodeTime( init ) * 1000.0, plain_size / link_bytes_per_sec );
+
+  const int levels[] = { 1, 6, 9 };
+  for ( size_t l = 0; l < sizeof( levels ) / sizeof( levels[0] ); l++ )
+  {
+    std::vector<uint8_t> data;
+
+    ros::WallTime start = ros::WallTime::now();
+    for ( unsigned run = 0; run < num_runs; run++ )
+    {
+      if ( !interactive_markers::compressInit( init, data, levels[l] ) )
+      {
+        printf( "compression failed\n" );
+        return 1;
+      }
+    }
+    double compress_time = ( ros::WallTime::now() - start ).toSec() / num_runs;
+
+    start = ros::WallTime::now();
+    for ( unsigned run = 0; run < num_runs; run++ )
+    {
+      InteractiveMarkerInit decoded;
+      if ( !interactive_markers::decompressInit( data, decoded ) )
+      {
+        printf( "decompression failed\n" );
+        return 1;
+      }
+    }
+    double decode_time = ( ros::WallTime::now() - start ).toSec() / num_runs;
+
+    printf( "%8d %14lu %10.2f %16.2f %16.2f %14.2f\n", levels[l], (unsigned long)data.size(),
+        double( plain_size ) / data.size(), compress_time * 1000.0, decode_time * 1000.0,
+        data.size() / link_bytes_per_sec );
+  }
+
+  return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Measures the time from publishing a feedback message until the
+// server's feedback callback runs on its own spin thread, and how
+// long it takes to shut that thread down.
+
+#include <ros/ros.h>
+
+#include <interactive_markers/interactive_marker_server.h>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
+#include <stdio.h>
+
+using namespace visualization_msgs;
+
+const unsigned num_feedbacks = 1000;
+const double feedback_interval = 0.002;
+
+boost::mutex latencies_mutex;
+std::vector<double> latencies;
+
+void processFeedback( const InteractiveMarkerFeedbackConstPtr &feedback )
+{
+  double latency = ros::WallTime::now().toSec() - feedback->header.stamp.toSec();
+  boost::mutex::scoped_lock lock( latencies_mutex );
+  latencies.push_back( latency );
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "feedback_latency_benchmark");
+  ros::NodeHandle nh;
+
+  boost::scoped_ptr<interactive_markers::InteractiveMarkerServer> server(
+      new interactive_markers::InteractiveMarkerServer( "feedback_latency_benchmark", "", true ) );
+
+  InteractiveMarker int_marker;
+  int_marker.name = "marker";
+  int_marker.header.frame_id = "/base_link";
+  int_marker.pose.orientation.w = 1;
+  server->insert( int_marker, &processFeedback );
+  server->applyChanges();
+
+  ros::Publisher feedback_pub = nh.advertise<InteractiveMarkerFeedback>( "feedback_latency_benchmark/feedback", 100 );
+  while ( ros::ok() && feedback_pub.getNumSubscribers() == 0 )
+  {
+    ros::WallDuration( 0.01 ).sleep();
+  }
+
+  InteractiveMarkerFeedback feedback;
+  feedback.client_id = "feedback_latency_benchmark";
+  feedback.marker_name = "marker";
+  feedback.event_type = InteractiveMarkerFeedback::BUTTON_CLICK;
+
+  for ( unsigned i=0; i<num_feedbacks && ros::ok(); i++ )
+  {
+    feedback.header.stamp = ros::Time( ros::WallTime::now().toSec() );
+    feedback_pub.publish( feedback );
+    ros::WallDuration( feedback_interval ).sleep();
+  }
+
+  // give the last callbacks some time to arrive
+  ros::WallDuration( 0.1 ).sleep();
+
+  ros::WallTime shutdown_start = ros::WallTime::now();
+  server.reset();
+  ros::WallDuration shutdown_time = ros::WallTime::now() - shutdown_start;
+
+  boost::mutex::scoped_lock lock( latencies_mutex );
+  if ( latencies.empty() )
+  {
+    printf( "No feedback received.\n" );
+    return 1;
+  }
+
+  std::sort( latencies.begin(), latencies.end() );
+  double sum = 0;
+  for ( size_t i=0; i<latencies.size(); i++ )
+  {
+    sum += latencies[i];
+  }
+
+  printf( "%12s %12s %12s %12s %12s %14s\n", "received", "mean [ms]", "median [ms]", "99% [ms]", "max [ms]", "shutdown [ms]" );
+  printf( "%7lu/%-4u %12.3f %12.3f %12.3f %12.3f %14.3f\n",
+      (unsigned long)latencies.size(), num_feedbacks,
+      sum / latencies.size() * 1000.0,
+      latencies[latencies.size() / 2] * 1000.0,
+      latencies[latencies.size() * 99 / 100] * 1000.0,
+      latencies.back() * 1000.0,
+      shutdown_time.toSec() * 1000.0 );
+
+  return 0;
+}
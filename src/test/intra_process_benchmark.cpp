@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Compares passing updates between a server and a subscriber in the same
+// process, as nodelets in one manager do, with separate processes that
+// communicate over TCPROS.
+//
+// In the same process:    intra_process_benchmark both
+// In separate processes:  intra_process_benchmark client &
+//                         intra_process_benchmark server
+//
+// Each process prints its update latency and CPU time.
+
+#include <ros/ros.h>
+
+#include <interactive_markers/interactive_marker_server.h>
+
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+
+using namespace visualization_msgs;
+
+const unsigned num_markers = 100;
+const unsigned num_points = 1000;
+const unsigned num_updates = 500;
+const double update_rate = 50.0;
+const char* topic_ns = "intra_process_benchmark";
+
+boost::mutex latencies_mutex;
+std::vector<double> latencies;
+
+double cpuTime()
+{
+  struct rusage usage;
+  getrusage( RUSAGE_SELF, &usage );
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+      usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+void updateCb( const InteractiveMarkerUpdateConstPtr &update )
+{
+  if ( update->type != InteractiveMarkerUpdate::UPDATE || update->markers.empty() )
+  {
+    return;
+  }
+  double latency = ros::WallTime::now().toSec() - update->markers[0].header.stamp.toSec();
+  boost::mutex::scoped_lock lock( latencies_mutex );
+  latencies.push_back( latency );
+}
+
+InteractiveMarker makeMarker( unsigned i )
+{
+  std::ostringstream s;
+  s << "marker_" << i;
+
+  InteractiveMarker int_marker;
+  int_marker.name = s.str();
+  int_marker.header.frame_id = "/base_link";
+  int_marker.pose.orientation.w = 1;
+
+  InteractiveMarkerControl control;
+  control.always_visible = true;
+  Marker marker;
+  marker.type = Marker::TRIANGLE_LIST;
+  marker.scale.x = marker.scale.y = marker.scale.z = 1;
+  marker.points.resize( num_points );
+  for ( unsigned p = 0; p < num_points; p++ )
+  {
+    marker.points[p].x = p;
+  }
+  control.markers.push_back( marker );
+  int_marker.controls.push_back( control );
+  return int_marker;
+}
+
+void runServer()
+{
+  interactive_markers::InteractiveMarkerServer server( topic_ns );
+
+  std::vector<InteractiveMarker> int_markers;
+  for ( unsigned i = 0; i < num_markers; i++ )
+  {
+    int_markers.push_back( makeMarker( i ) );
+  }
+
+  // give subscribers time to connect
+  ros::WallDuration( 1.0 ).sleep();
+
+  ros::WallRate rate( update_rate );
+  for ( unsigned n = 0; n < num_updates && ros::ok(); n++ )
+  {
+    ros::Time stamp( ros::WallTime::now().toSec() );
+    for ( unsigned i = 0; i < num_markers; i++ )
+    {
+      int_markers[i].header.stamp = stamp;
+      server.insert( int_markers[i] );
+    }
+    server.applyChanges();
+    rate.sleep();
+  }
+}
+
+void printResults( const char* mode, double cpu_time )
+{
+  boost::mutex::scoped_lock lock( latencies_mutex );
+
+  printf( "%8s %12s %12s %12s %12s %12s\n", "mode", "received", "mean [ms]", "median [ms]", "max [ms]", "cpu [s]" );
+  if ( latencies.empty() )
+  {
+    printf( "%8s %12s %12s %12s %12s %12.3f\n", mode, "0", "-", "-", "-", cpu_time );
+    return;
+  }
+
+  std::sort( latencies.begin(), latencies.end() );
+  double sum = 0;
+  for ( size_t i = 0; i < latencies.size(); i++ )
+  {
+    sum += latencies[i];
+  }
+
+  printf( "%8s %12lu %12.3f %12.3f %12.3f %12.3f\n", mode,
+      (unsigned long)latencies.size(),
+      sum / latencies.size() * 1000.0,
+      latencies[latencies.size() / 2] * 1000.0,
+      latencies.back() * 1000.0,
+      cpu_time );
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "intra_process_benchmark", ros::init_options::AnonymousName);
+
+  std::string mode = argc > 1 ? argv[1] : "both";
+  bool server = mode == "both" || mode == "server";
+  bool client = mode == "both" || mode == "client";
+  if ( !server && !client )
+  {
+    printf( "usage: intra_process_benchmark [both|server|client]\n" );
+    return 1;
+  }
+
+  ros::NodeHandle nh;
+  ros::AsyncSpinner spinner( 1 );
+  ros::Subscriber update_sub;
+  if ( client )
+  {
+    update_sub = nh.subscribe( std::string( topic_ns ) + "/update", 100, &updateCb );
+    spinner.start();
+  }
+
+  double cpu_start = cpuTime();
+
+  if ( server )
+  {
+    runServer();
+    // give the last updates some time to arrive
+    ros::WallDuration( 0.5 ).sleep();
+  }
+  else
+  {
+    // receive until the server has been quiet for a while
+    size_t num_received = 0;
+    ros::WallTime last_receive = ros::WallTime::now();
+    while ( ros::ok() )
+    {
+      ros::WallDuration( 0.5 ).sleep();
+      boost::mutex::scoped_lock lock( latencies_mutex );
+      if ( latencies.size() != num_received )
+      {
+        num_received = latencies.size();
+        last_receive = ros::WallTime::now();
+      }
+      else if ( num_received > 0 && ( ros::WallTime::now() - last_receive ).toSec() > 2.0 )
+      {
+        break;
+      }
+    }
+  }
+
+  printResults( mode.c_str(), cpuTime() - cpu_start );
+  return 0;
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Stress test for concurrent access to an InteractiveMarkerServer.
+// A growing number of reader threads call get() while writer threads
+// call setPose() and one thread calls applyChanges() at 100 Hz.
+
+#include <ros/ros.h>
+
+#include <interactive_markers/interactive_marker_server.h>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <stdio.h>
+
+using namespace visualization_msgs;
+
+const unsigned num_markers = 1000;
+const unsigned num_writers = 2;
+const double test_duration = 2.0;
+
+volatile bool stop;
+
+std::string markerName( unsigned i )
+{
+  std::ostringstream s;
+  s << "marker_" << i;
+  return s.str();
+}
+
+void readerLoop( interactive_markers::InteractiveMarkerServer* server, unsigned seed, uint64_t* count )
+{
+  InteractiveMarker int_marker;
+  unsigned i = seed;
+  while ( !stop )
+  {
+    server->get( markerName( i++ % num_markers ), int_marker );
+    (*count)++;
+  }
+}
+
+void writerLoop( interactive_markers::InteractiveMarkerServer* server, unsigned seed, uint64_t* count )
+{
+  geometry_msgs::Pose pose;
+  pose.orientation.w = 1;
+  unsigned i = seed;
+  while ( !stop )
+  {
+    pose.position.x = i;
+    server->setPose( markerName( i++ % num_markers ), pose );
+    (*count)++;
+  }
+}
+
+void applyLoop( interactive_markers::InteractiveMarkerServer* server, uint64_t* count, double* max_time )
+{
+  while ( !stop )
+  {
+    ros::WallTime start = ros::WallTime::now();
+    server->applyChanges();
+    double time = (ros::WallTime::now() - start).toSec();
+    if ( time > *max_time )
+    {
+      *max_time = time;
+    }
+    (*count)++;
+    ros::WallDuration( 0.01 ).sleep();
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "server_stress_benchmark");
+
+  interactive_markers::InteractiveMarkerServer server("server_stress_benchmark");
+
+  InteractiveMarker int_marker;
+  int_marker.header.frame_id = "/base_link";
+  int_marker.pose.orientation.w = 1;
+  int_marker.controls.resize(1);
+  int_marker.controls[0].interaction_mode = InteractiveMarkerControl::MOVE_3D;
+  for ( unsigned i=0; i<num_markers; i++ )
+  {
+    int_marker.name = markerName(i);
+    server.insert( int_marker );
+  }
+  server.applyChanges();
+
+  printf( "%8s %14s %14s %14s %18s\n", "readers", "get() [1/s]", "setPose() [1/s]", "apply [1/s]", "max apply [ms]" );
+
+  for ( unsigned num_readers=1; num_readers<=16; num_readers*=2 )
+  {
+    std::vector<uint64_t> read_counts( num_readers, 0 );
+    std::vector<uint64_t> write_counts( num_writers, 0 );
+    uint64_t apply_count = 0;
+    double max_apply_time = 0;
+
+    stop = false;
+    boost::thread_group threads;
+    for ( unsigned r=0; r<num_readers; r++ )
+    {
+      threads.create_thread( boost::bind( &readerLoop, &server, r * 101, &read_counts[r] ) );
+    }
+    for ( unsigned w=0; w<num_writers; w++ )
+    {
+      threads.create_thread( boost::bind( &writerLoop, &server, w * 307, &write_counts[w] ) );
+    }
+    threads.create_thread( boost::bind( &applyLoop, &server, &apply_count, &max_apply_time ) );
+
+    ros::WallDuration( test_duration ).sleep();
+    stop = true;
+    threads.join_all();
+
+    uint64_t reads = 0, writes = 0;
+    for ( unsigned r=0; r<num_readers; r++ )
+    {
+      reads += read_counts[r];
+    }
+    for ( unsigned w=0; w<num_writers; w++ )
+    {
+      writes += write_counts[w];
+    }
+
+    printf( "%8u %14.0f %14.0f %14.1f %18.2f\n", num_readers,
+        reads / test_duration, writes / test_duration, apply_count / test_duration,
+        max_apply_time * 1000.0 );
+  }
+
+  return 0;
+}
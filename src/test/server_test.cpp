@@ -33,6 +33,12 @@
 #include <gtest/gtest.h>
 
 #include <interactive_markers/interactive_marker_server.h>
+#include <interactive_markers/menu_handler.h>
+#include <interactive_markers/tools.h>
+#include <interactive_markers/detail/compact_poses.h>
+#include <interactive_markers/detail/compressed_init.h>
+
+#include <std_msgs/UInt8MultiArray.h>
 
 TEST(InteractiveMarkerServer, addRemove)
 {
@@ -84,6 +90,1278 @@ TEST(InteractiveMarkerServer, addRemove)
   usleep(1000);
 }
 
+TEST(InteractiveMarkerServer, setMenuEntries)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test");
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  int_marker.controls.resize(1);
+
+  std::vector<visualization_msgs::MenuEntry> menu_entries(2);
+  menu_entries[0].id = 1;
+  menu_entries[1].id = 2;
+
+  // unknown marker
+  ASSERT_FALSE( server.setMenuEntries( "marker1", menu_entries ) );
+
+  // pending insert
+  server.insert(int_marker);
+  ASSERT_TRUE( server.setMenuEntries( "marker1", menu_entries ) );
+  ASSERT_TRUE( server.get("marker1", int_marker) );
+  ASSERT_EQ( 2u, int_marker.menu_entries.size() );
+
+  // existing marker with a pending pose change
+  server.applyChanges();
+  int_marker.pose.position.x = 1.0;
+  ASSERT_TRUE( server.setPose( "marker1", int_marker.pose ) );
+  menu_entries.resize(1);
+  ASSERT_TRUE( server.setMenuEntries( "marker1", menu_entries ) );
+  ASSERT_TRUE( server.get("marker1", int_marker) );
+  ASSERT_EQ( 1u, int_marker.menu_entries.size() );
+  ASSERT_EQ( 1u, int_marker.controls.size() );
+  ASSERT_EQ( 1.0, int_marker.pose.position.x );
+
+  server.applyChanges();
+  ASSERT_TRUE( server.get("marker1", int_marker) );
+  ASSERT_EQ( 1u, int_marker.menu_entries.size() );
+  ASSERT_EQ( 1.0, int_marker.pose.position.x );
+
+  // pending erase
+  server.erase( "marker1" );
+  ASSERT_FALSE( server.setMenuEntries( "marker1", menu_entries ) );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+TEST(InteractiveMarkerServer, menuHandlerCache)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test");
+  interactive_markers::MenuHandler menu_handler;
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  int_marker.controls.resize(1);
+  server.insert(int_marker);
+
+  interactive_markers::MenuHandler::EntryHandle first = menu_handler.insert( "first" );
+  interactive_markers::MenuHandler::EntryHandle second = menu_handler.insert( "second" );
+  menu_handler.insert( second, "sub" );
+  ASSERT_TRUE( menu_handler.apply( server, "marker1" ) );
+  ASSERT_TRUE( server.get("marker1", int_marker) );
+  ASSERT_EQ( 3u, int_marker.menu_entries.size() );
+  ASSERT_EQ( "first", int_marker.menu_entries[0].title );
+  ASSERT_EQ( "sub", int_marker.menu_entries[2].title );
+  ASSERT_EQ( second, int_marker.menu_entries[2].parent_id );
+
+  // every change to the menu shows up in the next apply
+  ASSERT_TRUE( menu_handler.setCheckState( first, interactive_markers::MenuHandler::CHECKED ) );
+  ASSERT_TRUE( menu_handler.apply( server, "marker1" ) );
+  ASSERT_TRUE( server.get("marker1", int_marker) );
+  ASSERT_EQ( "[x] first", int_marker.menu_entries[0].title );
+
+  ASSERT_TRUE( menu_handler.setVisible( second, false ) );
+  ASSERT_TRUE( menu_handler.apply( server, "marker1" ) );
+  ASSERT_TRUE( server.get("marker1", int_marker) );
+  ASSERT_EQ( 1u, int_marker.menu_entries.size() );
+
+  menu_handler.insert( "third" );
+  ASSERT_TRUE( menu_handler.apply( server, "marker1" ) );
+  ASSERT_TRUE( server.get("marker1", int_marker) );
+  ASSERT_EQ( 2u, int_marker.menu_entries.size() );
+  ASSERT_EQ( "third", int_marker.menu_entries[1].title );
+
+  // unknown entries change nothing
+  ASSERT_FALSE( menu_handler.setVisible( 100, true ) );
+  ASSERT_TRUE( menu_handler.apply( server, "marker1" ) );
+  ASSERT_TRUE( server.get("marker1", int_marker) );
+  ASSERT_EQ( 2u, int_marker.menu_entries.size() );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+// sends feedback to a server as a client would
+struct FeedbackSender
+{
+  FeedbackSender( const std::string &topic_ns )
+  {
+    ros::NodeHandle nh;
+    feedback_pub = nh.advertise<visualization_msgs::InteractiveMarkerFeedback>( topic_ns + "/feedback", 100 );
+    for ( int i = 0; i < 100 && feedback_pub.getNumSubscribers() == 0; i++ )
+    {
+      usleep(10000);
+    }
+  }
+
+  void send( const std::string &marker_name, uint8_t event_type, uint32_t menu_entry_id = 0 )
+  {
+    visualization_msgs::InteractiveMarkerFeedback feedback;
+    feedback.client_id = "client";
+    feedback.marker_name = marker_name;
+    feedback.event_type = event_type;
+    feedback.menu_entry_id = menu_entry_id;
+    feedback_pub.publish( feedback );
+  }
+
+  ros::Publisher feedback_pub;
+};
+
+// records the feedback passed to a callback
+struct FeedbackRecorder
+{
+  void feedbackCb( const visualization_msgs::InteractiveMarkerFeedbackConstPtr &feedback )
+  {
+    boost::mutex::scoped_lock lock( mutex );
+    feedbacks.push_back( feedback );
+  }
+
+  bool waitForFeedback( size_t count )
+  {
+    for ( int i = 0; i < 100; i++ )
+    {
+      {
+        boost::mutex::scoped_lock lock( mutex );
+        if ( feedbacks.size() >= count )
+        {
+          return true;
+        }
+      }
+      ros::spinOnce();
+      usleep(10000);
+    }
+    return false;
+  }
+
+  boost::mutex mutex;
+  std::vector<visualization_msgs::InteractiveMarkerFeedbackConstPtr> feedbacks;
+};
+
+TEST(InteractiveMarkerServer, reApplyMenu)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test_menu");
+  interactive_markers::MenuHandler menu_handler;
+  FeedbackRecorder recorder;
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.controls.resize(1);
+  const char* names[] = { "marker1", "marker2", "marker3" };
+  for ( int i = 0; i < 3; i++ )
+  {
+    int_marker.name = names[i];
+    server.insert(int_marker);
+  }
+
+  interactive_markers::MenuHandler::EntryHandle entry =
+      menu_handler.insert( "entry", boost::bind( &FeedbackRecorder::feedbackCb, &recorder, _1 ) );
+  for ( int i = 0; i < 3; i++ )
+  {
+    ASSERT_TRUE( menu_handler.apply( server, names[i] ) );
+  }
+  server.applyChanges();
+
+  // all markers get the new menu, missing ones are forgotten
+  menu_handler.insert( "entry2" );
+  server.erase( "marker2" );
+  ASSERT_FALSE( menu_handler.reApply( server ) );
+  ASSERT_TRUE( server.get("marker1", int_marker) );
+  ASSERT_EQ( 2u, int_marker.menu_entries.size() );
+  ASSERT_TRUE( server.get("marker3", int_marker) );
+  ASSERT_EQ( 2u, int_marker.menu_entries.size() );
+  ASSERT_TRUE( menu_handler.reApply( server ) );
+
+  // the bulk call reports markers that do not exist
+  std::vector<std::string> marker_names( names, names + 3 );
+  std::vector<std::string> missing_names;
+  std::vector<visualization_msgs::MenuEntry> menu_entries( 1 );
+  menu_entries[0].id = entry;
+  ASSERT_FALSE( server.setMenuEntries( marker_names, menu_entries,
+      boost::bind( &FeedbackRecorder::feedbackCb, &recorder, _1 ), missing_names ) );
+  ASSERT_EQ( 1u, missing_names.size() );
+  ASSERT_EQ( "marker2", missing_names[0] );
+  ASSERT_TRUE( server.get("marker1", int_marker) );
+  ASSERT_EQ( 1u, int_marker.menu_entries.size() );
+  server.applyChanges();
+
+  // menu selections reach the callback of the bulk call
+  ASSERT_TRUE( menu_handler.reApply( server ) );
+  server.applyChanges();
+  FeedbackSender sender( "im_server_test_menu" );
+  sender.send( "marker1", visualization_msgs::InteractiveMarkerFeedback::MENU_SELECT, entry );
+  sender.send( "marker3", visualization_msgs::InteractiveMarkerFeedback::MENU_SELECT, entry );
+  ASSERT_TRUE( recorder.waitForFeedback( 2 ) );
+  ASSERT_EQ( "marker1", recorder.feedbacks[0]->marker_name );
+  ASSERT_EQ( "marker3", recorder.feedbacks[1]->marker_name );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+TEST(InteractiveMarkerServer, feedbackCallbacks)
+{
+  typedef visualization_msgs::InteractiveMarkerFeedback Feedback;
+  interactive_markers::InteractiveMarkerServer server("im_server_test_callbacks");
+  FeedbackRecorder default_recorder;
+  FeedbackRecorder click_recorder;
+  FeedbackRecorder other_recorder;
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  server.insert( int_marker, boost::bind( &FeedbackRecorder::feedbackCb, &default_recorder, _1 ) );
+  int_marker.name = "marker2";
+  server.insert( int_marker, boost::bind( &FeedbackRecorder::feedbackCb, &default_recorder, _1 ) );
+  ASSERT_TRUE( server.setCallback( "marker1", boost::bind( &FeedbackRecorder::feedbackCb, &click_recorder, _1 ),
+      Feedback::BUTTON_CLICK ) );
+  ASSERT_FALSE( server.setCallback( "marker1", boost::bind( &FeedbackRecorder::feedbackCb, &other_recorder, _1 ),
+      Feedback::MOUSE_UP + 1 ) );
+  ASSERT_FALSE( server.setCallback( "marker3", boost::bind( &FeedbackRecorder::feedbackCb, &other_recorder, _1 ) ) );
+  server.applyChanges();
+
+  // type-specific callbacks come first, the others go to the default one
+  FeedbackSender sender( "im_server_test_callbacks" );
+  sender.send( "marker1", Feedback::BUTTON_CLICK );
+  sender.send( "marker1", Feedback::MOUSE_DOWN );
+  sender.send( "marker2", Feedback::BUTTON_CLICK );
+  ASSERT_TRUE( click_recorder.waitForFeedback( 1 ) );
+  ASSERT_TRUE( default_recorder.waitForFeedback( 2 ) );
+  ASSERT_EQ( 1u, click_recorder.feedbacks.size() );
+  ASSERT_EQ( "marker1", default_recorder.feedbacks[0]->marker_name );
+  ASSERT_EQ( Feedback::MOUSE_DOWN, default_recorder.feedbacks[0]->event_type );
+  ASSERT_EQ( "marker2", default_recorder.feedbacks[1]->marker_name );
+
+  // replacing the default callback of one marker leaves the other one alone,
+  // and an empty type-specific callback falls back to the default one
+  ASSERT_TRUE( server.setCallback( "marker2", boost::bind( &FeedbackRecorder::feedbackCb, &other_recorder, _1 ) ) );
+  ASSERT_TRUE( server.setCallback( "marker1", interactive_markers::InteractiveMarkerServer::FeedbackCallback(),
+      Feedback::BUTTON_CLICK ) );
+  sender.send( "marker1", Feedback::BUTTON_CLICK );
+  sender.send( "marker2", Feedback::BUTTON_CLICK );
+  ASSERT_TRUE( default_recorder.waitForFeedback( 3 ) );
+  ASSERT_TRUE( other_recorder.waitForFeedback( 1 ) );
+  ASSERT_EQ( "marker1", default_recorder.feedbacks[2]->marker_name );
+  ASSERT_EQ( "marker2", other_recorder.feedbacks[0]->marker_name );
+  ASSERT_EQ( 1u, click_recorder.feedbacks.size() );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+TEST(InteractiveMarkerServer, readHandles)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test");
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  int_marker.header.frame_id = "frame1";
+  int_marker.controls.resize(1);
+
+  ASSERT_FALSE( server.get("marker1") );
+
+  server.insert(int_marker);
+  server.applyChanges();
+
+  visualization_msgs::InteractiveMarkerConstPtr handle = server.get("marker1");
+  ASSERT_TRUE( handle );
+  ASSERT_EQ( "frame1", handle->header.frame_id );
+
+  // pending pose change
+  geometry_msgs::Pose pose;
+  pose.position.x = 1.0;
+  std_msgs::Header header;
+  header.frame_id = "frame2";
+  ASSERT_TRUE( server.setPose( "marker1", pose, header ) );
+
+  geometry_msgs::Pose current_pose;
+  std_msgs::Header current_header;
+  ASSERT_TRUE( server.getPose( "marker1", current_pose ) );
+  ASSERT_TRUE( server.getHeader( "marker1", current_header ) );
+  ASSERT_EQ( 1.0, current_pose.position.x );
+  ASSERT_EQ( "frame2", current_header.frame_id );
+  ASSERT_EQ( 1.0, server.get("marker1")->pose.position.x );
+
+  // the handle must not change after applying
+  server.applyChanges();
+  ASSERT_EQ( 0.0, handle->pose.position.x );
+  ASSERT_EQ( "frame1", handle->header.frame_id );
+  ASSERT_EQ( 1.0, server.get("marker1")->pose.position.x );
+  ASSERT_EQ( 1u, server.get("marker1")->controls.size() );
+
+  server.erase( "marker1" );
+  ASSERT_FALSE( server.get("marker1") );
+  ASSERT_FALSE( server.getPose( "marker1", current_pose ) );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+TEST(InteractiveMarkerServer, applyChangesAsync)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test", "", false, 4);
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  server.insert(int_marker);
+  int_marker.name = "marker2";
+  server.insert(int_marker);
+
+  boost::shared_future<void> published = server.applyChangesAsync();
+  ASSERT_TRUE( server.get("marker1") );
+  ASSERT_TRUE( server.get("marker2") );
+
+  geometry_msgs::Pose pose;
+  pose.position.x = 1.0;
+  ASSERT_TRUE( server.setPose( "marker1", pose ) );
+  server.erase( "marker2" );
+
+  boost::shared_future<void> published2 = server.applyChangesAsync();
+  ASSERT_EQ( 1.0, server.get("marker1")->pose.position.x );
+  ASSERT_FALSE( server.get("marker2") );
+
+  published.wait();
+  published2.wait();
+
+  // nothing to publish, so the future is ready right away
+  ASSERT_TRUE( server.applyChangesAsync().is_ready() );
+
+  // synchronous updates go through the publisher thread now
+  server.clear();
+  server.applyChanges();
+  ASSERT_FALSE( server.get("marker1") );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+TEST(InteractiveMarkerServer, sharedExecutor)
+{
+  interactive_markers::InteractiveMarkerExecutor executor(2);
+  ASSERT_EQ( 2u, executor.getNumThreads() );
+
+  {
+    interactive_markers::InteractiveMarkerServer server1("im_server_test1", "", executor);
+    interactive_markers::InteractiveMarkerServer server2("im_server_test2", "", executor);
+
+    visualization_msgs::InteractiveMarker int_marker;
+    int_marker.name = "marker1";
+    server1.insert(int_marker);
+    server1.applyChanges();
+
+    ASSERT_TRUE( server1.get("marker1") );
+    ASSERT_FALSE( server2.get("marker1") );
+  }
+
+  // servers can come and go while the executor keeps running
+  interactive_markers::InteractiveMarkerServer server3("im_server_test3", "", executor);
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+TEST(InteractiveMarkerServer, skipUnchanged)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test");
+  server.setSkipUnchanged( true, 0.01 );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  int_marker.header.frame_id = "frame1";
+  int_marker.pose.orientation.w = 1.0;
+
+  server.insert(int_marker);
+  server.applyChanges();
+  ASSERT_EQ( 0u, server.getNumSkippedUpdates() );
+
+  // same marker again
+  server.insert(int_marker);
+  ASSERT_EQ( 1u, server.getNumSkippedUpdates() );
+
+  // same pose, and a change within the deadband
+  ASSERT_TRUE( server.setPose( "marker1", int_marker.pose ) );
+  geometry_msgs::Pose pose = int_marker.pose;
+  pose.position.x = 0.005;
+  ASSERT_TRUE( server.setPose( "marker1", pose ) );
+  ASSERT_EQ( 3u, server.getNumSkippedUpdates() );
+  ASSERT_EQ( 0.0, server.get("marker1")->pose.position.x );
+
+  // a real change goes through
+  pose.position.x = 0.1;
+  ASSERT_TRUE( server.setPose( "marker1", pose ) );
+  ASSERT_EQ( 0.1, server.get("marker1")->pose.position.x );
+
+  // a new frame is a change as well
+  std_msgs::Header header;
+  header.frame_id = "frame2";
+  ASSERT_TRUE( server.setPose( "marker1", pose, header ) );
+  ASSERT_EQ( "frame2", server.get("marker1")->header.frame_id );
+  ASSERT_EQ( 3u, server.getNumSkippedUpdates() );
+
+  // the marker differs from the inserted one now
+  server.applyChanges();
+  server.insert(int_marker);
+  ASSERT_EQ( 3u, server.getNumSkippedUpdates() );
+  ASSERT_EQ( "frame1", server.get("marker1")->header.frame_id );
+
+  // an erased marker can be inserted again
+  server.applyChanges();
+  server.erase("marker1");
+  server.insert(int_marker);
+  ASSERT_EQ( 3u, server.getNumSkippedUpdates() );
+  ASSERT_TRUE( server.get("marker1") );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+TEST(InteractiveMarkerServer, maxPublishRate)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test");
+  server.setMaxPublishRate( "fast", 10.0 );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "fast_marker";
+  server.insert(int_marker);
+  int_marker.name = "slow_marker";
+  server.insert(int_marker);
+  server.applyChanges();
+
+  geometry_msgs::Pose pose;
+  pose.position.x = 1.0;
+  ASSERT_TRUE( server.setPose( "fast_marker", pose ) );
+  ASSERT_TRUE( server.setPose( "slow_marker", pose ) );
+  server.applyChanges();
+
+  // the unlimited marker has no pending change left, so get() hands out
+  // the stored marker. The held pose still has to be merged into a copy.
+  ASSERT_EQ( server.get("slow_marker"), server.get("slow_marker") );
+  ASSERT_NE( server.get("fast_marker"), server.get("fast_marker") );
+  ASSERT_EQ( 1.0, server.get("fast_marker")->pose.position.x );
+
+  // newer poses replace the held one
+  pose.position.x = 2.0;
+  ASSERT_TRUE( server.setPose( "fast_marker", pose ) );
+  server.applyChanges();
+  ASSERT_NE( server.get("fast_marker"), server.get("fast_marker") );
+
+  usleep(110000);
+  server.applyChanges();
+  ASSERT_EQ( server.get("fast_marker"), server.get("fast_marker") );
+  ASSERT_EQ( 2.0, server.get("fast_marker")->pose.position.x );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+TEST(InteractiveMarkerServer, groups)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test");
+
+  // robot -> arm, both groups
+  geometry_msgs::Pose pose;
+  pose.position.x = 1.0;
+  pose.orientation.w = 1.0;
+  std_msgs::Header header;
+  header.frame_id = "map";
+  server.setGroupPose( "robot", pose, header );
+
+  // the arm is turned by 90 degrees around z
+  pose.position.x = 0.0;
+  pose.position.y = 2.0;
+  pose.orientation.z = sqrt(0.5);
+  pose.orientation.w = sqrt(0.5);
+  header.frame_id = "robot";
+  server.setGroupPose( "arm", pose, header );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "gripper";
+  int_marker.header.frame_id = "arm";
+  int_marker.pose.position.x = 3.0;
+  int_marker.pose.orientation.w = 1.0;
+  server.insert(int_marker);
+  server.applyChanges();
+
+  geometry_msgs::Pose absolute_pose;
+  std_msgs::Header absolute_header;
+  ASSERT_TRUE( server.getAbsolutePose( "gripper", absolute_pose, absolute_header ) );
+  ASSERT_EQ( "map", absolute_header.frame_id );
+  ASSERT_NEAR( 1.0, absolute_pose.position.x, 1e-9 );
+  ASSERT_NEAR( 5.0, absolute_pose.position.y, 1e-9 );
+  ASSERT_NEAR( sqrt(0.5), absolute_pose.orientation.z, 1e-9 );
+
+  // get() keeps the pose relative to the group
+  ASSERT_EQ( "arm", server.get("gripper")->header.frame_id );
+  ASSERT_EQ( 3.0, server.get("gripper")->pose.position.x );
+
+  // moving the robot moves the gripper
+  pose = geometry_msgs::Pose();
+  pose.orientation.w = 1.0;
+  header.frame_id = "map";
+  server.setGroupPose( "robot", pose, header );
+  ASSERT_TRUE( server.getAbsolutePose( "gripper", absolute_pose, absolute_header ) );
+  ASSERT_NEAR( 0.0, absolute_pose.position.x, 1e-9 );
+
+  ASSERT_TRUE( server.eraseGroup( "robot" ) );
+  ASSERT_FALSE( server.eraseGroup( "robot" ) );
+  ASSERT_TRUE( server.getAbsolutePose( "gripper", absolute_pose, absolute_header ) );
+  ASSERT_EQ( "robot", absolute_header.frame_id );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+TEST(InteractiveMarkerServer, spatialIndex)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test", "", false, 4);
+
+  geometry_msgs::Point center;
+  std::vector<visualization_msgs::InteractiveMarkerConstPtr> int_markers;
+  ASSERT_FALSE( server.findInRadius( "map", center, 1.0, int_markers ) );
+
+  // markers on a line along x, one per meter
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.header.frame_id = "map";
+  int_marker.pose.orientation.w = 1.0;
+  for ( int i = 0; i < 10; i++ )
+  {
+    std::ostringstream s;
+    s << "marker" << i;
+    int_marker.name = s.str();
+    int_marker.pose.position.x = i;
+    server.insert(int_marker);
+  }
+  server.applyChanges();
+
+  // markers inserted before the index existed are found as well
+  server.setSpatialIndex( 2.0 );
+  ASSERT_TRUE( server.findInRadius( "map", center, 2.5, int_markers ) );
+  ASSERT_EQ( 3u, int_markers.size() );
+
+  // a marker in another frame is not found
+  int_marker.name = "other_frame";
+  int_marker.header.frame_id = "base_link";
+  int_marker.pose.position.x = 0.0;
+  server.insert(int_marker);
+
+  // moving and erasing markers updates the index right away
+  geometry_msgs::Pose pose;
+  pose.position.x = 100.0;
+  ASSERT_TRUE( server.setPose( "marker0", pose ) );
+  server.erase( "marker1" );
+
+  geometry_msgs::Point min, max;
+  min.x = -1.0; min.y = -1.0; min.z = -1.0;
+  max.x = 2.5; max.y = 1.0; max.z = 1.0;
+  int_markers.clear();
+  ASSERT_TRUE( server.findInBox( "map", min, max, int_markers ) );
+  ASSERT_EQ( 1u, int_markers.size() );
+  ASSERT_EQ( "marker2", int_markers[0]->name );
+
+  center.x = 100.0;
+  int_markers.clear();
+  ASSERT_TRUE( server.findInRadius( "map", center, 0.1, int_markers ) );
+  ASSERT_EQ( 1u, int_markers.size() );
+  ASSERT_EQ( 100.0, int_markers[0]->pose.position.x );
+
+  server.clear();
+  int_markers.clear();
+  ASSERT_TRUE( server.findInRadius( "map", center, 1000.0, int_markers ) );
+  ASSERT_TRUE( int_markers.empty() );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+// records the messages published by a server on one topic namespace
+struct TopicRecorder
+{
+  TopicRecorder( const std::string &topic_ns, const std::string &update_topic = "update" )
+  {
+    ros::NodeHandle nh;
+    update_sub = nh.subscribe( topic_ns + "/" + update_topic, 100, &TopicRecorder::updateCb, this );
+    init_sub = nh.subscribe( topic_ns + "/update_full", 100, &TopicRecorder::initCb, this );
+    compressed_init_sub = nh.subscribe( topic_ns + "/update_full_compressed", 100, &TopicRecorder::compressedInitCb, this );
+    compact_pose_sub = nh.subscribe( topic_ns + "/update_poses_compact", 100, &TopicRecorder::compactPoseCb, this );
+    prototypes_sub = nh.subscribe( topic_ns + "/prototypes", 100, &TopicRecorder::prototypesCb, this );
+  }
+
+  ~TopicRecorder()
+  {
+    update_sub.shutdown();
+    init_sub.shutdown();
+    compressed_init_sub.shutdown();
+    compact_pose_sub.shutdown();
+    prototypes_sub.shutdown();
+  }
+
+  void updateCb( const visualization_msgs::InteractiveMarkerUpdateConstPtr &update )
+  {
+    if ( update->type == visualization_msgs::InteractiveMarkerUpdate::UPDATE )
+    {
+      updates.push_back( update );
+    }
+  }
+
+  void initCb( const visualization_msgs::InteractiveMarkerInitConstPtr &init )
+  {
+    inits.push_back( init );
+  }
+
+  void compressedInitCb( const std_msgs::UInt8MultiArrayConstPtr &msg )
+  {
+    visualization_msgs::InteractiveMarkerInitPtr init( new visualization_msgs::InteractiveMarkerInit() );
+    ASSERT_TRUE( interactive_markers::decompressInit( msg->data, *init ) );
+    compressed_inits.push_back( init );
+  }
+
+  void compactPoseCb( const std_msgs::UInt8MultiArrayConstPtr &msg )
+  {
+    visualization_msgs::InteractiveMarkerUpdatePtr update( new visualization_msgs::InteractiveMarkerUpdate() );
+    ASSERT_TRUE( interactive_markers::decodeCompactPoses( msg->data, *update ) );
+    compact_updates.push_back( update );
+  }
+
+  void prototypesCb( const visualization_msgs::InteractiveMarkerInitConstPtr &msg )
+  {
+    prototypes.push_back( msg );
+  }
+
+  // wait until the given number of updates has arrived
+  bool waitForUpdates( size_t num_updates )
+  {
+    for ( int i = 0; i < 100 && updates.size() < num_updates; i++ )
+    {
+      ros::spinOnce();
+      usleep(10000);
+    }
+    return updates.size() == num_updates;
+  }
+
+  // wait until an init message with the given sequence number has arrived
+  bool waitForInit( uint64_t seq_num )
+  {
+    for ( int i = 0; i < 100 && ( inits.empty() || inits.back()->seq_num != seq_num ); i++ )
+    {
+      ros::spinOnce();
+      usleep(10000);
+    }
+    return !inits.empty() && inits.back()->seq_num == seq_num;
+  }
+
+  // wait until the given number of compressed init messages has arrived
+  bool waitForCompressedInits( size_t num_inits )
+  {
+    for ( int i = 0; i < 100 && compressed_inits.size() < num_inits; i++ )
+    {
+      ros::spinOnce();
+      usleep(10000);
+    }
+    return compressed_inits.size() == num_inits;
+  }
+
+  ros::Subscriber update_sub;
+  ros::Subscriber init_sub;
+  ros::Subscriber compressed_init_sub;
+  ros::Subscriber compact_pose_sub;
+  ros::Subscriber prototypes_sub;
+  std::vector<visualization_msgs::InteractiveMarkerUpdateConstPtr> updates;
+  std::vector<visualization_msgs::InteractiveMarkerInitConstPtr> inits;
+  std::vector<visualization_msgs::InteractiveMarkerInitConstPtr> compressed_inits;
+  std::vector<visualization_msgs::InteractiveMarkerUpdateConstPtr> compact_updates;
+  std::vector<visualization_msgs::InteractiveMarkerInitConstPtr> prototypes;
+};
+
+// counts the callbacks that run at the same time
+struct ConcurrencyRecorder
+{
+  ConcurrencyRecorder() : running(0), max_running(0), calls(0) {}
+
+  void feedbackCb( const visualization_msgs::InteractiveMarkerFeedbackConstPtr& )
+  {
+    {
+      boost::mutex::scoped_lock lock( mutex );
+      running++;
+      max_running = std::max( max_running, running );
+    }
+    usleep(1000);
+    {
+      boost::mutex::scoped_lock lock( mutex );
+      running--;
+      calls++;
+    }
+  }
+
+  boost::mutex mutex;
+  int running;
+  int max_running;
+  int calls;
+};
+
+void sendFeedback( FeedbackSender *sender, int count )
+{
+  for ( int i = 0; i < count; i++ )
+  {
+    sender->send( "marker1", visualization_msgs::InteractiveMarkerFeedback::BUTTON_CLICK );
+  }
+}
+
+TEST(InteractiveMarkerServer, serializedFeedback)
+{
+  interactive_markers::InteractiveMarkerExecutor executor(4);
+  interactive_markers::InteractiveMarkerServer server("im_server_test_serialized", "", executor);
+  interactive_markers::InteractiveMarkerServer::InterestFilter filter;
+  ASSERT_TRUE( server.addFilteredTopic( "im_server_test_serialized/filtered", filter ) );
+
+  ConcurrencyRecorder recorder;
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  server.insert( int_marker, boost::bind( &ConcurrencyRecorder::feedbackCb, &recorder, _1 ) );
+  server.applyChanges();
+
+  // feedback through the main and the filtered topic at the same time
+  FeedbackSender sender( "im_server_test_serialized" );
+  FeedbackSender filtered_sender( "im_server_test_serialized/filtered" );
+  boost::thread thread( boost::bind( &sendFeedback, &sender, 50 ) );
+  boost::thread filtered_thread( boost::bind( &sendFeedback, &filtered_sender, 50 ) );
+  thread.join();
+  filtered_thread.join();
+
+  for ( int i = 0; i < 200; i++ )
+  {
+    {
+      boost::mutex::scoped_lock lock( recorder.mutex );
+      if ( recorder.calls == 100 )
+      {
+        break;
+      }
+    }
+    usleep(10000);
+  }
+  boost::mutex::scoped_lock lock( recorder.mutex );
+  ASSERT_EQ( 100, recorder.calls );
+  ASSERT_EQ( 1, recorder.max_running );
+}
+
+TEST(InteractiveMarkerServer, flushHeldPoses)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test_flush");
+  TopicRecorder recorder( "im_server_test_flush" );
+  server.setMaxPublishRate( "", 10.0 );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  server.insert(int_marker);
+  server.applyChanges();
+  ASSERT_TRUE( recorder.waitForUpdates( 1 ) );
+
+  // held back, and nothing calls applyChanges() again
+  geometry_msgs::Pose pose;
+  pose.position.x = 1.0;
+  ASSERT_TRUE( server.setPose( "marker1", pose ) );
+  server.applyChanges();
+  usleep(10000);
+  ros::spinOnce();
+  ASSERT_EQ( 1u, recorder.updates.size() );
+
+  ASSERT_TRUE( recorder.waitForUpdates( 2 ) );
+  ASSERT_EQ( 1u, recorder.updates[1]->poses.size() );
+  ASSERT_EQ( 1.0, recorder.updates[1]->poses[0].pose.position.x );
+  ASSERT_EQ( server.get("marker1"), server.get("marker1") );
+
+  // changes that were not applied yet are not flushed
+  pose.position.x = 2.0;
+  ASSERT_TRUE( server.setPose( "marker1", pose ) );
+  server.applyChanges();
+  pose.position.x = 3.0;
+  ASSERT_TRUE( server.setPose( "marker1", pose ) );
+  usleep(200000);
+  ros::spinOnce();
+  ASSERT_EQ( 2u, recorder.updates.size() );
+  server.applyChanges();
+  ASSERT_TRUE( recorder.waitForUpdates( 3 ) );
+  ASSERT_EQ( 3.0, recorder.updates[2]->poses[0].pose.position.x );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+TEST(InteractiveMarkerServer, filteredTopics)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test_filtered");
+
+  interactive_markers::InteractiveMarkerServer::InterestFilter robot1_filter;
+  robot1_filter.name_prefix = "robot1/";
+  ASSERT_TRUE( server.addFilteredTopic( "im_server_test_filtered/robot1", robot1_filter ) );
+  ASSERT_FALSE( server.addFilteredTopic( "im_server_test_filtered/robot1", robot1_filter ) );
+  TopicRecorder robot1( "im_server_test_filtered/robot1" );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.header.frame_id = "map";
+  int_marker.pose.position.x = 5.0;
+  int_marker.pose.orientation.w = 1.0;
+  int_marker.name = "robot1/marker";
+  server.insert(int_marker);
+  int_marker.name = "robot2/marker";
+  server.insert(int_marker);
+  server.applyChanges();
+
+  ASSERT_TRUE( robot1.waitForUpdates( 1 ) );
+  ASSERT_EQ( 1u, robot1.updates[0]->seq_num );
+  ASSERT_EQ( 1u, robot1.updates[0]->markers.size() );
+  ASSERT_EQ( "robot1/marker", robot1.updates[0]->markers[0].name );
+  ASSERT_TRUE( robot1.waitForInit( 1 ) );
+  ASSERT_EQ( 1u, robot1.inits.back()->markers.size() );
+
+  // nothing in the region yet
+  interactive_markers::InteractiveMarkerServer::InterestFilter region_filter;
+  region_filter.region_frame = "map";
+  region_filter.region_max.x = region_filter.region_max.y = region_filter.region_max.z = 1.0;
+  ASSERT_TRUE( server.addFilteredTopic( "im_server_test_filtered/region", region_filter ) );
+  TopicRecorder region( "im_server_test_filtered/region" );
+  ASSERT_TRUE( region.waitForInit( 0 ) );
+  ASSERT_EQ( 0u, region.inits.back()->markers.size() );
+
+  // moving into the region sends the whole marker, moving out erases it
+  geometry_msgs::Pose pose = int_marker.pose;
+  pose.position.x = 0.5;
+  ASSERT_TRUE( server.setPose( "robot2/marker", pose ) );
+  server.applyChanges();
+  ASSERT_TRUE( region.waitForUpdates( 1 ) );
+  ASSERT_EQ( 1u, region.updates[0]->markers.size() );
+  ASSERT_EQ( 0.5, region.updates[0]->markers[0].pose.position.x );
+  ASSERT_EQ( 0u, region.updates[0]->poses.size() );
+
+  pose.position.y = 0.5;
+  ASSERT_TRUE( server.setPose( "robot2/marker", pose ) );
+  server.applyChanges();
+  ASSERT_TRUE( region.waitForUpdates( 2 ) );
+  ASSERT_EQ( 2u, region.updates[1]->seq_num );
+  ASSERT_EQ( 1u, region.updates[1]->poses.size() );
+
+  pose.position.x = 2.0;
+  ASSERT_TRUE( server.setPose( "robot2/marker", pose ) );
+  server.applyChanges();
+  ASSERT_TRUE( region.waitForUpdates( 3 ) );
+  ASSERT_EQ( 1u, region.updates[2]->erases.size() );
+
+  // the other robot's changes never reached the first topic
+  ASSERT_EQ( 1u, robot1.updates.size() );
+
+  ASSERT_TRUE( server.removeFilteredTopic( "im_server_test_filtered/region" ) );
+  ASSERT_FALSE( server.removeFilteredTopic( "im_server_test_filtered/region" ) );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+// holds up the thread that publishes on an update topic until released
+struct UpdateBlocker
+{
+  UpdateBlocker( const std::string &topic_ns )
+  : blocking(false)
+  , blocked(false)
+  {
+    ros::NodeHandle nh;
+    sub = nh.subscribe( topic_ns + "/update", 100, &UpdateBlocker::updateCb, this );
+  }
+
+  ~UpdateBlocker()
+  {
+    sub.shutdown();
+  }
+
+  void updateCb( const visualization_msgs::InteractiveMarkerUpdateConstPtr & )
+  {
+    boost::mutex::scoped_lock lock( mutex );
+    if ( !blocking )
+    {
+      return;
+    }
+    blocked = true;
+    cond.notify_all();
+    while ( blocking )
+    {
+      cond.wait( lock );
+    }
+  }
+
+  void block()
+  {
+    boost::mutex::scoped_lock lock( mutex );
+    blocking = true;
+  }
+
+  bool waitUntilBlocked()
+  {
+    boost::mutex::scoped_lock lock( mutex );
+    boost::system_time timeout = boost::get_system_time() + boost::posix_time::seconds( 1 );
+    while ( !blocked )
+    {
+      if ( !cond.timed_wait( lock, timeout ) )
+      {
+        return blocked;
+      }
+    }
+    return true;
+  }
+
+  void release()
+  {
+    boost::mutex::scoped_lock lock( mutex );
+    blocking = false;
+    cond.notify_all();
+  }
+
+  ros::Subscriber sub;
+  boost::mutex mutex;
+  boost::condition_variable cond;
+  bool blocking;
+  bool blocked;
+};
+
+TEST(InteractiveMarkerServer, filteredTopicsAsync)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test_filtered_async");
+
+  interactive_markers::InteractiveMarkerServer::InterestFilter region_filter;
+  region_filter.region_frame = "map";
+  region_filter.region_max.x = region_filter.region_max.y = region_filter.region_max.z = 1.0;
+  ASSERT_TRUE( server.addFilteredTopic( "im_server_test_filtered_async/region", region_filter ) );
+  TopicRecorder region( "im_server_test_filtered_async/region" );
+  UpdateBlocker blocker( "im_server_test_filtered_async" );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.header.frame_id = "map";
+  int_marker.pose.position.x = 5.0;
+  int_marker.pose.orientation.w = 1.0;
+  int_marker.name = "marker";
+  int_marker.description = "old";
+  server.insert(int_marker);
+  server.applyChanges();
+
+  // keep the move into the region from being published
+  blocker.block();
+  geometry_msgs::Pose pose = int_marker.pose;
+  pose.position.x = 0.5;
+  ASSERT_TRUE( server.setPose( "marker", pose ) );
+  server.applyChangesAsync();
+  ASSERT_TRUE( blocker.waitUntilBlocked() );
+
+  // a newer marker is applied meanwhile
+  int_marker.pose = pose;
+  int_marker.description = "new";
+  server.insert(int_marker);
+  boost::shared_future<void> published = server.applyChangesAsync();
+  blocker.release();
+  published.wait();
+
+  // the region gets each marker as it was when its update was applied
+  ASSERT_TRUE( region.waitForUpdates( 2 ) );
+  ASSERT_EQ( 1u, region.updates[0]->markers.size() );
+  ASSERT_EQ( "old", region.updates[0]->markers[0].description );
+  ASSERT_EQ( 0.5, region.updates[0]->markers[0].pose.position.x );
+  ASSERT_EQ( 1u, region.updates[1]->markers.size() );
+  ASSERT_EQ( "new", region.updates[1]->markers[0].description );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+TEST(InteractiveMarkerServer, separatePoseTopic)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test_poses");
+  server.setSeparatePoseTopic( true );
+  TopicRecorder recorder( "im_server_test_poses" );
+  TopicRecorder pose_recorder( "im_server_test_poses", "update_poses" );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  server.insert(int_marker);
+  server.applyChanges();
+
+  geometry_msgs::Pose pose;
+  pose.position.x = 1.0;
+  ASSERT_TRUE( server.setPose( "marker1", pose ) );
+  int_marker.name = "marker2";
+  server.insert(int_marker);
+  server.applyChanges();
+
+  // both parts of the second update share its sequence number
+  ASSERT_TRUE( recorder.waitForUpdates( 2 ) );
+  ASSERT_TRUE( pose_recorder.waitForUpdates( 1 ) );
+  ASSERT_EQ( 2u, recorder.updates[1]->seq_num );
+  ASSERT_EQ( 1u, recorder.updates[1]->markers.size() );
+  ASSERT_EQ( 0u, recorder.updates[1]->poses.size() );
+  ASSERT_EQ( 2u, pose_recorder.updates[0]->seq_num );
+  ASSERT_EQ( 1u, pose_recorder.updates[0]->poses.size() );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+TEST(InteractiveMarkerServer, maxMessageSize)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test_split");
+  TopicRecorder recorder( "im_server_test_split" );
+
+  // every change needs a message of its own
+  server.setMaxMessageSize( 1 );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  server.insert(int_marker);
+  int_marker.name = "marker2";
+  server.insert(int_marker);
+  server.applyChanges();
+
+  ASSERT_TRUE( recorder.waitForUpdates( 2 ) );
+  ASSERT_EQ( 1u, recorder.updates[0]->seq_num );
+  ASSERT_EQ( 2u, recorder.updates[1]->seq_num );
+  ASSERT_EQ( 1u, recorder.updates[0]->markers.size() );
+  ASSERT_EQ( 1u, recorder.updates[1]->markers.size() );
+  ASSERT_TRUE( recorder.waitForInit( 2 ) );
+  ASSERT_EQ( 2u, recorder.inits.back()->markers.size() );
+
+  server.setMaxMessageSize( 0 );
+  geometry_msgs::Pose pose;
+  ASSERT_TRUE( server.setPose( "marker1", pose ) );
+  ASSERT_TRUE( server.setPose( "marker2", pose ) );
+  server.applyChanges();
+  ASSERT_TRUE( recorder.waitForUpdates( 3 ) );
+  ASSERT_EQ( 3u, recorder.updates[2]->seq_num );
+  ASSERT_EQ( 2u, recorder.updates[2]->poses.size() );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+TEST(InteractiveMarkerServer, compressedInit)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test_compressed");
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  server.insert(int_marker);
+  server.applyChanges();
+
+  TopicRecorder recorder( "im_server_test_compressed" );
+  ASSERT_TRUE( recorder.waitForInit( 1 ) );
+  ASSERT_TRUE( recorder.compressed_inits.empty() );
+
+  // the current state is published right away
+  server.setCompressedInit( true );
+  ASSERT_TRUE( recorder.waitForCompressedInits( 1 ) );
+  ASSERT_EQ( 1u, recorder.compressed_inits[0]->seq_num );
+  ASSERT_EQ( 1u, recorder.compressed_inits[0]->markers.size() );
+  ASSERT_EQ( "marker1", recorder.compressed_inits[0]->markers[0].name );
+
+  int_marker.name = "marker2";
+  server.insert(int_marker);
+  server.applyChanges();
+  ASSERT_TRUE( recorder.waitForInit( 2 ) );
+  ASSERT_TRUE( recorder.waitForCompressedInits( 2 ) );
+  ASSERT_EQ( 2u, recorder.compressed_inits[1]->seq_num );
+  ASSERT_EQ( 2u, recorder.compressed_inits[1]->markers.size() );
+
+  server.setCompressedInit( false );
+  server.erase( "marker1" );
+  server.applyChanges();
+  ASSERT_TRUE( recorder.waitForInit( 3 ) );
+  ASSERT_EQ( 2u, recorder.compressed_inits.size() );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+TEST(InteractiveMarkerServer, compactPoses)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test_compact");
+  TopicRecorder recorder( "im_server_test_compact" );
+  server.setCompactPoses( 0.001 );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  int_marker.header.frame_id = "base";
+  server.insert(int_marker);
+  server.applyChanges();
+  ASSERT_TRUE( recorder.waitForUpdates( 1 ) );
+
+  geometry_msgs::Pose pose;
+  pose.position.x = 1.23456;
+  pose.position.y = -2.0;
+  pose.position.z = 0.5;
+  pose.orientation.z = M_SQRT1_2;
+  pose.orientation.w = M_SQRT1_2;
+  std_msgs::Header header;
+  header.frame_id = "base";
+  header.stamp = ros::Time( 10, 0 );
+  ASSERT_TRUE( server.setPose( "marker1", pose, header ) );
+  server.applyChanges();
+
+  // the poses only go out on the compact topic
+  ASSERT_TRUE( recorder.waitForUpdates( 2 ) );
+  ASSERT_TRUE( recorder.updates[1]->poses.empty() );
+  ASSERT_EQ( 1u, recorder.compact_updates.size() );
+
+  const visualization_msgs::InteractiveMarkerUpdate &update = *recorder.compact_updates[0];
+  ASSERT_EQ( 2u, update.seq_num );
+  ASSERT_EQ( 1u, update.poses.size() );
+  ASSERT_EQ( "marker1", update.poses[0].name );
+  ASSERT_EQ( "base", update.poses[0].header.frame_id );
+  ASSERT_EQ( header.stamp, update.poses[0].header.stamp );
+  ASSERT_NEAR( 1.235, update.poses[0].pose.position.x, 1e-9 );
+  ASSERT_NEAR( -2.0, update.poses[0].pose.position.y, 1e-9 );
+  ASSERT_NEAR( 0.5, update.poses[0].pose.position.z, 1e-9 );
+  ASSERT_NEAR( 0.0, update.poses[0].pose.orientation.x, 2e-3 );
+  ASSERT_NEAR( 0.0, update.poses[0].pose.orientation.y, 2e-3 );
+  ASSERT_NEAR( M_SQRT1_2, fabs( update.poses[0].pose.orientation.z ), 2e-3 );
+  ASSERT_NEAR( M_SQRT1_2, fabs( update.poses[0].pose.orientation.w ), 2e-3 );
+
+  server.setCompactPoses( 0.0 );
+  ASSERT_TRUE( server.setPose( "marker1", pose, header ) );
+  server.applyChanges();
+  ASSERT_TRUE( recorder.waitForUpdates( 3 ) );
+  ASSERT_EQ( 1u, recorder.updates[2]->poses.size() );
+  ASSERT_EQ( 1u, recorder.compact_updates.size() );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+TEST(InteractiveMarkerServer, prototypes)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test_prototypes");
+  TopicRecorder recorder( "im_server_test_prototypes" );
+
+  visualization_msgs::InteractiveMarkerControl control;
+  control.name = "handle";
+  control.markers.push_back( visualization_msgs::Marker() );
+  std::vector<visualization_msgs::InteractiveMarkerControl> controls( 1, control );
+  ASSERT_TRUE( server.addPrototype( "arm", controls ) );
+  ASSERT_FALSE( server.addPrototype( "arm", controls ) );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  interactive_markers::usePrototype( int_marker, "arm" );
+  server.insert(int_marker);
+  server.applyChanges();
+
+  // the server keeps the reference, clients get the controls
+  visualization_msgs::InteractiveMarker stored;
+  ASSERT_TRUE( server.get( "marker1", stored ) );
+  ASSERT_EQ( 1u, stored.controls.size() );
+  ASSERT_TRUE( stored.controls[0].markers.empty() );
+
+  ASSERT_TRUE( recorder.waitForUpdates( 1 ) );
+  ASSERT_EQ( 1u, recorder.updates[0]->markers[0].controls.size() );
+  ASSERT_EQ( "handle", recorder.updates[0]->markers[0].controls[0].name );
+  ASSERT_EQ( 1u, recorder.updates[0]->markers[0].controls[0].markers.size() );
+
+  // shared prototypes go out once, the markers only refer to them
+  ASSERT_TRUE( recorder.prototypes.empty() );
+  server.setSharedPrototypes( true );
+  for ( int i = 0; i < 100 && recorder.prototypes.empty(); i++ )
+  {
+    ros::spinOnce();
+    usleep(10000);
+  }
+  ASSERT_EQ( 1u, recorder.prototypes.size() );
+  ASSERT_EQ( 1u, recorder.prototypes[0]->markers.size() );
+  ASSERT_EQ( "arm", recorder.prototypes[0]->markers[0].name );
+  ASSERT_EQ( "handle", recorder.prototypes[0]->markers[0].controls[0].name );
+
+  int_marker.name = "marker2";
+  server.insert(int_marker);
+  server.applyChanges();
+  ASSERT_TRUE( recorder.waitForUpdates( 2 ) );
+  ASSERT_EQ( 1u, recorder.updates[1]->markers[0].controls.size() );
+  ASSERT_TRUE( recorder.updates[1]->markers[0].controls[0].markers.empty() );
+  ASSERT_TRUE( recorder.waitForInit( 2 ) );
+  ASSERT_TRUE( recorder.inits.back()->markers[0].controls[0].markers.empty() );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+
+TEST(InteractiveMarkerServer, levelsOfDetail)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test_lod");
+  std::vector<uint32_t> max_points( 1, 300 );
+  // zero budgets are ignored, so the filter below falls back to 300 points
+  max_points.push_back( 0 );
+  server.setLevelsOfDetail( max_points );
+
+  interactive_markers::InteractiveMarkerServer::InterestFilter filter;
+  filter.max_points = 100;
+  ASSERT_TRUE( server.addFilteredTopic( "im_server_test_lod/coarse", filter ) );
+  TopicRecorder full( "im_server_test_lod" );
+  TopicRecorder coarse( "im_server_test_lod/coarse" );
+
+  // a 40x40 grid, two triangles per cell
+  visualization_msgs::Marker mesh;
+  mesh.type = visualization_msgs::Marker::TRIANGLE_LIST;
+  mesh.scale.x = mesh.scale.y = mesh.scale.z = 1.0;
+  for ( int i = 0; i < 40; i++ )
+  {
+    for ( int j = 0; j < 40; j++ )
+    {
+      geometry_msgs::Point p[4];
+      p[0].x = i;     p[0].y = j;
+      p[1].x = i + 1; p[1].y = j;
+      p[2].x = i + 1; p[2].y = j + 1;
+      p[3].x = i;     p[3].y = j + 1;
+      int order[6] = { 0, 1, 2, 0, 2, 3 };
+      for ( int k = 0; k < 6; k++ )
+      {
+        mesh.points.push_back( p[order[k]] );
+      }
+      // one color per triangle
+      std_msgs::ColorRGBA color;
+      color.r = i / 40.0;
+      color.g = j / 40.0;
+      color.a = 1.0;
+      mesh.colors.push_back( color );
+      mesh.colors.push_back( color );
+    }
+  }
+
+  visualization_msgs::InteractiveMarkerControl control;
+  control.markers.push_back( mesh );
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "terrain";
+  int_marker.pose.orientation.w = 1.0;
+  int_marker.controls.push_back( control );
+  // a control without large meshes goes out as it is
+  visualization_msgs::InteractiveMarkerControl button;
+  button.name = "button";
+  button.interaction_mode = visualization_msgs::InteractiveMarkerControl::BUTTON;
+  int_marker.controls.push_back( button );
+  server.insert(int_marker);
+  server.applyChanges();
+
+  ASSERT_TRUE( full.waitForUpdates( 1 ) );
+  ASSERT_EQ( mesh.points.size(), full.updates[0]->markers[0].controls[0].markers[0].points.size() );
+
+  ASSERT_TRUE( coarse.waitForUpdates( 1 ) );
+  const visualization_msgs::Marker &decimated = coarse.updates[0]->markers[0].controls[0].markers[0];
+  ASSERT_EQ( visualization_msgs::Marker::TRIANGLE_LIST, decimated.type );
+  ASSERT_LE( decimated.points.size(), 300u );
+  ASSERT_GT( decimated.points.size(), 0u );
+  ASSERT_EQ( 0u, decimated.points.size() % 3 );
+  ASSERT_EQ( decimated.points.size(), decimated.colors.size() * 3 );
+  ASSERT_EQ( 2u, coarse.updates[0]->markers[0].controls.size() );
+  ASSERT_EQ( "button", coarse.updates[0]->markers[0].controls[1].name );
+  ASSERT_TRUE( coarse.waitForInit( 1 ) );
+  ASSERT_LE( coarse.inits.back()->markers[0].controls[0].markers[0].points.size(), 300u );
+
+  // the stored marker keeps full detail
+  visualization_msgs::InteractiveMarker stored;
+  ASSERT_TRUE( server.get( "terrain", stored ) );
+  ASSERT_EQ( mesh.points.size(), stored.controls[0].markers[0].points.size() );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
 
 // Run all the tests that were declared with TEST()
 int main(int argc, char **argv)
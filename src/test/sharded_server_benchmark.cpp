@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Benchmark for concurrent producers on a sharded InteractiveMarkerServer.
+// A growing number of producer threads call setPose() on disjoint sets of
+// markers while one thread calls applyChanges() at 100 Hz, once with a
+// single shard and once with several.
+
+#include <ros/ros.h>
+
+#include <interactive_markers/interactive_marker_server.h>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <stdio.h>
+
+using namespace visualization_msgs;
+
+const unsigned num_markers = 1024;
+const unsigned max_producers = 16;
+const double test_duration = 2.0;
+
+volatile bool stop;
+
+std::string markerName( unsigned i )
+{
+  std::ostringstream s;
+  s << "marker_" << i;
+  return s.str();
+}
+
+void producerLoop( interactive_markers::InteractiveMarkerServer* server,
+    const std::vector<std::string>* names, unsigned producer, unsigned num_producers, uint64_t* count )
+{
+  geometry_msgs::Pose pose;
+  pose.orientation.w = 1;
+  unsigned i = producer;
+  while ( !stop )
+  {
+    pose.position.x = i;
+    server->setPose( (*names)[i], pose );
+    (*count)++;
+    i += num_producers;
+    if ( i >= names->size() )
+    {
+      i = producer;
+    }
+  }
+}
+
+void applyLoop( interactive_markers::InteractiveMarkerServer* server, double* max_time )
+{
+  while ( !stop )
+  {
+    ros::WallTime start = ros::WallTime::now();
+    server->applyChanges();
+    double time = (ros::WallTime::now() - start).toSec();
+    if ( time > *max_time )
+    {
+      *max_time = time;
+    }
+    ros::WallDuration( 0.01 ).sleep();
+  }
+}
+
+void runBenchmark( unsigned num_shards, const std::vector<std::string> &names )
+{
+  interactive_markers::InteractiveMarkerServer server( "sharded_server_benchmark", "", false, num_shards );
+
+  InteractiveMarker int_marker;
+  int_marker.header.frame_id = "/base_link";
+  int_marker.pose.orientation.w = 1;
+  int_marker.controls.resize(1);
+  int_marker.controls[0].interaction_mode = InteractiveMarkerControl::MOVE_3D;
+  for ( unsigned i=0; i<names.size(); i++ )
+  {
+    int_marker.name = names[i];
+    server.insert( int_marker );
+  }
+  server.applyChanges();
+
+  for ( unsigned num_producers=1; num_producers<=max_producers; num_producers*=2 )
+  {
+    std::vector<uint64_t> counts( num_producers, 0 );
+    double max_apply_time = 0;
+
+    stop = false;
+    boost::thread_group threads;
+    for ( unsigned p=0; p<num_producers; p++ )
+    {
+      threads.create_thread( boost::bind( &producerLoop, &server, &names, p, num_producers, &counts[p] ) );
+    }
+    threads.create_thread( boost::bind( &applyLoop, &server, &max_apply_time ) );
+
+    ros::WallDuration( test_duration ).sleep();
+    stop = true;
+    threads.join_all();
+
+    uint64_t writes = 0;
+    for ( unsigned p=0; p<num_producers; p++ )
+    {
+      writes += counts[p];
+    }
+
+    printf( "%8u %10u %16.0f %18.2f\n", num_shards, num_producers,
+        writes / test_duration, max_apply_time * 1000.0 );
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "sharded_server_benchmark");
+
+  std::vector<std::string> names( num_markers );
+  for ( unsigned i=0; i<num_markers; i++ )
+  {
+    names[i] = markerName(i);
+  }
+
+  printf( "%8s %10s %16s %18s\n", "shards", "producers", "setPose() [1/s]", "max apply [ms]" );
+
+  runBenchmark( 1, names );
+  runBenchmark( max_producers, names );
+
+  return 0;
+}
@@ -28,6 +28,7 @@
  */
 
 #include "interactive_markers/tools.h"
+#include "interactive_markers/detail/prototypes.h"
 
 #include <tf/LinearMath/Quaternion.h>
 #include <tf/LinearMath/Matrix3x3.h>
@@ -35,13 +36,69 @@
 #include <math.h>
 #include <assert.h>
 
+#include <algorithm>
+#include <deque>
 #include <set>
 #include <sstream>
 
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/once.hpp>
+#include <boost/thread/thread.hpp>
+
 namespace interactive_markers
 {
 
-void autoComplete( visualization_msgs::InteractiveMarker &msg )
+namespace
+{
+
+// marker ids are unique across all calls to autoComplete()
+boost::mutex marker_id_mutex;
+unsigned next_marker_id = 0;
+
+// reserve a block of consecutive marker ids
+unsigned reserveMarkerIds( unsigned count )
+{
+  boost::mutex::scoped_lock lock( marker_id_mutex );
+  unsigned first_id = next_marker_id;
+  next_marker_id += count;
+  return first_id;
+}
+
+unsigned countMarkers( const visualization_msgs::InteractiveMarker &msg )
+{
+  unsigned count = 0;
+  for ( unsigned c=0; c<msg.controls.size(); c++ )
+  {
+    count += msg.controls[c].markers.size();
+  }
+  return count;
+}
+
+void assignMarkerIds( visualization_msgs::InteractiveMarkerControl &control, unsigned &id )
+{
+  for ( unsigned m=0; m<control.markers.size(); m++ )
+  {
+    control.markers[m].id = id++;
+  }
+}
+
+void assignMarkerIds( visualization_msgs::InteractiveMarker &msg, unsigned &id )
+{
+  for ( unsigned c=0; c<msg.controls.size(); c++ )
+  {
+    assignMarkerIds( msg.controls[c], id );
+  }
+}
+
+// autoComplete() for one control, except for the marker ids
+void completeControl( const visualization_msgs::InteractiveMarker &msg,
+    visualization_msgs::InteractiveMarkerControl &control );
+
+// autoComplete() for one interactive marker, except for the marker ids
+void completeMarker( visualization_msgs::InteractiveMarker &msg )
 {
   // this is a 'delete' message. no need for action.
   if ( msg.controls.empty() )
@@ -74,12 +131,164 @@ void autoComplete( visualization_msgs::InteractiveMarker &msg )
   // complete the controls
   for ( unsigned c=0; c<msg.controls.size(); c++ )
   {
-    autoComplete( msg, msg.controls[c] );
+    completeControl( msg, msg.controls[c] );
   }
 
   uniqueifyControlNames( msg );
 }
 
+// worker function for the batch version of autoComplete()
+void completeMarkers( std::vector<visualization_msgs::InteractiveMarker> &msgs, size_t begin, size_t end )
+{
+  for ( size_t i=begin; i<end; i++ )
+  {
+    completeMarker( msgs[i] );
+  }
+}
+
+// number of batches of one autoComplete() call that are not done yet
+struct OpenBatches
+{
+  boost::mutex mutex;
+  boost::condition_variable done;
+  size_t count;
+};
+
+void completeBatch( std::vector<visualization_msgs::InteractiveMarker> &msgs, size_t begin, size_t end,
+    OpenBatches &open_batches )
+{
+  completeMarkers( msgs, begin, end );
+
+  boost::mutex::scoped_lock lock( open_batches.mutex );
+  if ( --open_batches.count == 0 )
+  {
+    open_batches.done.notify_all();
+  }
+}
+
+// worker threads shared by all calls to the batch version of autoComplete(),
+// so that completing a message does not start and join threads
+class CompletionPool
+{
+public:
+  CompletionPool( unsigned num_threads )
+  {
+    for ( unsigned t=0; t<num_threads; t++ )
+    {
+      threads_.create_thread( boost::bind( &CompletionPool::work, this ) );
+    }
+  }
+
+  void post( const boost::function<void()> &task )
+  {
+    boost::mutex::scoped_lock lock( mutex_ );
+    tasks_.push_back( task );
+    task_available_.notify_one();
+  }
+
+private:
+  void work()
+  {
+    while ( true )
+    {
+      boost::function<void()> task;
+      {
+        boost::mutex::scoped_lock lock( mutex_ );
+        while ( tasks_.empty() )
+        {
+          task_available_.wait( lock );
+        }
+        task = tasks_.front();
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+  boost::mutex mutex_;
+  boost::condition_variable task_available_;
+  std::deque< boost::function<void()> > tasks_;
+  boost::thread_group threads_;
+};
+
+// created on first use and never destroyed, so the workers can't outlive it
+CompletionPool *completion_pool = 0;
+boost::once_flag completion_pool_once = BOOST_ONCE_INIT;
+
+void createCompletionPool()
+{
+  // the calling thread completes one batch itself
+  unsigned num_threads = std::max( boost::thread::hardware_concurrency(), 2u ) - 1;
+  completion_pool = new CompletionPool( num_threads );
+}
+
+}
+
+void autoComplete( visualization_msgs::InteractiveMarker &msg )
+{
+  completeMarker( msg );
+
+  unsigned id = reserveMarkerIds( countMarkers( msg ) );
+  assignMarkerIds( msg, id );
+}
+
+void autoComplete( std::vector<visualization_msgs::InteractiveMarker> &msgs,
+    const AutoCompleteOptions &options )
+{
+  size_t num_threads = options.num_threads;
+  if ( num_threads == 0 )
+  {
+    num_threads = boost::thread::hardware_concurrency();
+  }
+
+  // don't hand out batches smaller than min_batch_size
+  size_t min_batch_size = options.min_batch_size > 0 ? options.min_batch_size : 1;
+  if ( num_threads > msgs.size() / min_batch_size )
+  {
+    num_threads = msgs.size() / min_batch_size;
+  }
+
+  if ( num_threads <= 1 )
+  {
+    completeMarkers( msgs, 0, msgs.size() );
+  }
+  else
+  {
+    boost::call_once( &createCompletionPool, completion_pool_once );
+
+    // the calling thread takes care of the last batch
+    OpenBatches open_batches;
+    open_batches.count = num_threads-1;
+    size_t begin = 0;
+    for ( size_t t=0; t<num_threads-1; t++ )
+    {
+      size_t end = msgs.size() * (t+1) / num_threads;
+      completion_pool->post( boost::bind( &completeBatch, boost::ref(msgs), begin, end, boost::ref(open_batches) ) );
+      begin = end;
+    }
+    completeMarkers( msgs, begin, msgs.size() );
+
+    boost::mutex::scoped_lock lock( open_batches.mutex );
+    while ( open_batches.count > 0 )
+    {
+      open_batches.done.wait( lock );
+    }
+  }
+
+  // assign marker ids in order, so the result does not depend on the number of threads
+  unsigned num_markers = 0;
+  for ( size_t i=0; i<msgs.size(); i++ )
+  {
+    num_markers += countMarkers( msgs[i] );
+  }
+
+  unsigned id = reserveMarkerIds( num_markers );
+  for ( size_t i=0; i<msgs.size(); i++ )
+  {
+    assignMarkerIds( msgs[i], id );
+  }
+}
+
 void uniqueifyControlNames( visualization_msgs::InteractiveMarker& msg )
 {
   int uniqueification_number = 0;
@@ -98,8 +307,28 @@ void uniqueifyControlNames( visualization_msgs::InteractiveMarker& msg )
   }
 }
 
+void usePrototype( visualization_msgs::InteractiveMarker &msg, const std::string &prototype )
+{
+  visualization_msgs::InteractiveMarkerControl control;
+  control.name = prototypeControlName( prototype );
+  control.interaction_mode = visualization_msgs::InteractiveMarkerControl::NONE;
+  msg.controls.push_back( control );
+}
+
 void autoComplete( const visualization_msgs::InteractiveMarker &msg,
     visualization_msgs::InteractiveMarkerControl &control )
+{
+  completeControl( msg, control );
+
+  unsigned id = reserveMarkerIds( control.markers.size() );
+  assignMarkerIds( control, id );
+}
+
+namespace
+{
+
+void completeControl( const visualization_msgs::InteractiveMarker &msg,
+    visualization_msgs::InteractiveMarkerControl &control )
 {
   // correct empty orientation
   if ( control.orientation.w == 0 && control.orientation.x == 0 &&
@@ -182,13 +411,11 @@ void autoComplete( const visualization_msgs::InteractiveMarker &msg,
     marker.pose.orientation.y = marker_orientation.y();
     marker.pose.orientation.z = marker_orientation.z();
     marker.pose.orientation.w = marker_orientation.w();
-
-    static volatile unsigned id = 0;
-    marker.id = id++;
-    marker.ns = msg.name;
   }
 }
 
+}
+
 void makeArrow( const visualization_msgs::InteractiveMarker &msg,
     visualization_msgs::InteractiveMarkerControl &control, float pos )
 {